@@ -41,6 +41,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "truffle.h"
 #include "cut.h"
 
@@ -88,50 +92,411 @@ m_to_i(char month)
 	}
 }
 
-static struct trcc_s*
+static char
+i_to_m(unsigned int month)
+{
+	static const char months[] = "?FGHJKMNQUVXZ";
+
+	return months[month <= 12U ? month : 0U];
+}
+
+static size_t
 __cut_find_cc(trcut_t c, uint8_t mon, uint16_t year)
 {
 	for (size_t i = 0; i < c->ncomps; i++) {
 		if (c->comps[i].month == mon && c->comps[i].year == year) {
-			return c->comps + i;
+			return i;
 		}
 	}
-	return NULL;
+	return c->ncomps;
 }
 
-
+static unsigned int
+__cut_slot(trcut_t c, uint8_t mon, uint16_t year)
+{
+/* return the slot of MON/YEAR or TRCUT_NSLOT if it's outside the window */
+	unsigned int k = (unsigned int)(year - c->ybase);
+	unsigned int m = m_to_i(mon);
+
+	if (UNLIKELY(year < c->ybase || !m ||
+		     (k = k * 12U + m - 1U) >= TRCUT_NSLOT)) {
+		return TRCUT_NSLOT;
+	}
+	return k;
+}
+
+static void
+__cut_rebase(trcut_t c, uint16_t year)
+{
+/* move the slot window to start at YEAR or the earliest year of
+ * the live components, whichever is less, and reindex */
+	uint16_t yb = year;
+
+	for (size_t i = 0; i < c->ncomps; i++) {
+		if (c->comps[i].month && c->comps[i].year < yb) {
+			yb = c->comps[i].year;
+		}
+	}
+	c->ybase = yb;
+	c->act = 0U;
+	c->nspill = 0U;
+	for (size_t i = 0; i < c->ncomps; i++) {
+		const struct trcc_s *cc = c->comps + i;
+		unsigned int s;
+
+		if (!cc->month) {
+			continue;
+		} else if ((s = __cut_slot(c, cc->month, cc->year)) <
+			   TRCUT_NSLOT) {
+			c->act |= 1ULL << s;
+			c->pos[s] = (uint32_t)i;
+		} else {
+			c->nspill++;
+		}
+	}
+	return;
+}
+
+static size_t
+__cut_free_idx(trcut_t c)
+{
+/* return the index of the first removed component, or NCOMPS */
+	if (c->hole) {
+		return __builtin_ctzll(c->hole);
+	} else if (c->nhole) {
+		for (size_t i = 64U; i < c->ncomps; i++) {
+			if (c->comps[i].month == 0) {
+				return i;
+			}
+		}
+	}
+	return c->ncomps;
+}
+
+
 /* public API */
 DEFUN trcut_t
 cut_add_cc(trcut_t c, struct trcc_s cc)
 {
-	struct trcc_s *prev;
+	unsigned int s;
+	size_t i;
 
 	if (c == NULL) {
 		size_t new = sizeof(*c) + 16 * sizeof(*c->comps);
 		c = calloc(new, 1);
-	} else if ((prev = __cut_find_cc(c, cc.month, cc.year))) {
-		prev->y = cc.y;
-		return c;
-	} else if ((prev = __cut_find_cc(c, 0, 0))) {
-		*prev = cc;
-		return c;
-	} else if ((c->ncomps % 16) == 0) {
-		size_t new = sizeof(*c) + (c->ncomps + 16) * sizeof(*c->comps);
+		c->zcomps = 16U;
+		c->ybase = cc.year;
+	}
+	if ((s = __cut_slot(c, cc.month, cc.year)) >= TRCUT_NSLOT) {
+		/* try and move the window */
+		__cut_rebase(c, cc.year);
+		s = __cut_slot(c, cc.month, cc.year);
+	}
+	if (LIKELY(s < TRCUT_NSLOT)) {
+		if (c->act & 1ULL << s) {
+			i = c->pos[s];
+			goto upd;
+		}
+	} else if (c->nspill &&
+		   (i = __cut_find_cc(c, cc.month, cc.year)) < c->ncomps) {
+		goto upd;
+	}
+
+	/* new component, reuse the first removed one if any */
+	if ((i = __cut_free_idx(c)) < c->ncomps) {
+		if (i < 64U) {
+			c->hole &= ~(1ULL << i);
+		}
+		c->nhole--;
+	} else if (c->ncomps >= c->zcomps) {
+		size_t new = sizeof(*c) + (c->zcomps + 16) * sizeof(*c->comps);
 		c = realloc(c, new);
-		memset(c->comps + c->ncomps, 0, 16 * sizeof(*c->comps));
+		memset(c->comps + c->zcomps, 0, 16 * sizeof(*c->comps));
+		c->zcomps += 16U;
+		i = c->ncomps++;
+	} else {
+		i = c->ncomps++;
+	}
+	c->comps[i] = cc;
+	if (s < TRCUT_NSLOT) {
+		c->act |= 1ULL << s;
+		c->pos[s] = (uint32_t)i;
+	} else {
+		c->nspill++;
+	}
+	c->gen++;
+	c->cgen++;
+	return c;
+
+upd:
+	if (c->comps[i].y != cc.y) {
+		c->comps[i].y = cc.y;
+		c->gen++;
 	}
-	c->comps[c->ncomps++] = cc;
 	return c;
 }
 
 DEFUN void
-cut_rem_cc(trcut_t UNUSED(c), struct trcc_s *cc)
+cut_rinse(trcut_t c)
 {
+	for (size_t i = 0; i < c->ncomps; i++) {
+		c->comps[i].y = 0.0;
+	}
+	c->gen++;
+	return;
+}
+
+DEFUN void
+cut_rem_cc(trcut_t c, struct trcc_s *cc)
+{
+	size_t i = cc - c->comps;
+	unsigned int s;
+
+	if (UNLIKELY(cc->month == 0)) {
+		/* already gone */
+		return;
+	} else if ((s = __cut_slot(c, cc->month, cc->year)) < TRCUT_NSLOT) {
+		c->act &= ~(1ULL << s);
+	} else {
+		c->nspill--;
+	}
 	cc->month = 0;
 	cc->year = 0;
+	c->gen++;
+	c->cgen++;
+	if (i + 1U < c->ncomps) {
+		/* leave a hole */
+		if (i < 64U) {
+			c->hole |= 1ULL << i;
+		}
+		c->nhole++;
+		return;
+	}
+	/* last one, trim trailing holes so iterations stop early */
+	for (c->ncomps--; c->ncomps && !c->comps[c->ncomps - 1U].month;) {
+		if (--c->ncomps < 64U) {
+			c->hole &= ~(1ULL << c->ncomps);
+		}
+		c->nhole--;
+	}
 	return;
 }
 
+static uint32_t
+cal_find_con(int32_t **cons, uint32_t *ncons, int32_t ym)
+{
+/* return the index of YM in CONS, adding it if need be */
+	uint32_t res;
+
+	for (res = 0U; res < *ncons; res++) {
+		if ((*cons)[res] == ym) {
+			return res;
+		}
+	}
+	if ((*ncons % 64U) == 0U) {
+		*cons = realloc(*cons, (*ncons + 64U) * sizeof(**cons));
+	}
+	(*cons)[(*ncons)++] = ym;
+	return res;
+}
+
+DEFUN int
+write_roll_calendar(trsch_t sch, idate_t from, idate_t till, FILE *whither)
+{
+/* evaluate a year's worth of days at a time */
+#define CAL_CHUNK	(366U)
+	const daysi_t dfrom = idate_to_daysi(from);
+	const daysi_t dtill = idate_to_daysi(till);
+	struct trcal_hdr_s hdr = {
+		.magic = TRCAL_MAGIC,
+		.version = TRCAL_VERSION,
+		.endian = TRCAL_ENDIAN,
+		.from = from,
+	};
+	int32_t *cons = NULL;
+	uint64_t *idx;
+	struct trcal_pair_s *pairs = NULL;
+	size_t npairs = 0U;
+	size_t zpairs = 0U;
+	int res = 0;
+
+	if (UNLIKELY(dtill < dfrom)) {
+		return -1;
+	}
+	hdr.ndays = dtill - dfrom + 1U;
+	idx = malloc((hdr.ndays + 1U) * sizeof(*idx));
+
+	for (daysi_t d0 = dfrom; d0 <= dtill; d0 += CAL_CHUNK) {
+		daysi_t dates[CAL_CHUNK];
+		size_t n = dtill - d0 + 1U;
+		uint32_t *map;
+		trcuts_t c;
+
+		if (n > CAL_CHUNK) {
+			n = CAL_CHUNK;
+		}
+		for (size_t k = 0; k < n; k++) {
+			dates[k] = d0 + k;
+		}
+		c = make_cuts(sch, dates, n);
+
+		/* map columns to contract indices */
+		map = malloc((c->ncons + 1U) * sizeof(*map));
+		for (size_t j = 0; j < c->ncons; j++) {
+			int32_t ym = c->cons[j].year << 8U |
+				m_to_i(c->cons[j].month);
+
+			map[j] = cal_find_con(&cons, &hdr.ncons, ym);
+		}
+		for (size_t k = 0; k < n; k++) {
+			idx[d0 - dfrom + k] = npairs;
+			for (size_t j = 0; j < c->ncons; j++) {
+				double y = c->y[j * c->ndates + k];
+
+				if (y == 0.0) {
+					continue;
+				} else if (npairs >= zpairs) {
+					zpairs = (zpairs * 2U) ?: 1024U;
+					pairs = realloc(
+						pairs, zpairs * sizeof(*pairs));
+				}
+				pairs[npairs].con = map[j];
+				pairs[npairs].pad = 0U;
+				pairs[npairs].y = y;
+				npairs++;
+			}
+		}
+		free(map);
+		free_cuts(c);
+	}
+	idx[hdr.ndays] = npairs;
+
+	/* lay out the file */
+	hdr.ioff = sizeof(hdr) + hdr.ncons * sizeof(*cons);
+	hdr.ioff = (hdr.ioff + 7U) & ~7ULL;
+	hdr.poff = hdr.ioff + (hdr.ndays + 1U) * sizeof(*idx);
+
+	if (fwrite(&hdr, sizeof(hdr), 1, whither) < 1 ||
+	    fwrite(cons, sizeof(*cons), hdr.ncons, whither) < hdr.ncons ||
+	    ((hdr.ncons % 2U) && fwrite(&(int32_t){0}, 4, 1, whither) < 1) ||
+	    fwrite(idx, sizeof(*idx), hdr.ndays + 1U, whither) <
+	    hdr.ndays + 1U ||
+	    fwrite(pairs, sizeof(*pairs), npairs, whither) < npairs) {
+		res = -1;
+	}
+	free(cons);
+	free(idx);
+	free(pairs);
+	return res;
+#undef CAL_CHUNK
+}
+
+struct trcal_s {
+	void *map;
+	size_t mapz;
+	const struct trcal_hdr_s *hdr;
+	daysi_t from;
+	const int32_t *cons;
+	const uint64_t *idx;
+	const struct trcal_pair_s *pairs;
+};
+
+DEFUN trcal_t
+read_roll_calendar(const char *file)
+{
+	const struct trcal_hdr_s *hdr;
+	struct stat st;
+	trcal_t res;
+	size_t z;
+	void *map;
+	int fd;
+
+	if ((fd = open(file, O_RDONLY)) < 0) {
+		return NULL;
+	} else if (fstat(fd, &st) < 0 ||
+		   (size_t)st.st_size < sizeof(*hdr)) {
+		close(fd);
+		return NULL;
+	}
+	z = st.st_size;
+	map = mmap(NULL, z, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return NULL;
+	}
+
+	hdr = map;
+	if (memcmp(hdr->magic, TRCAL_MAGIC, sizeof(hdr->magic)) ||
+	    hdr->version != TRCAL_VERSION || hdr->endian != TRCAL_ENDIAN) {
+		/* not ours or from a host of different byte order */
+		goto nope;
+	} else if (hdr->ioff < sizeof(*hdr) + hdr->ncons * sizeof(int32_t) ||
+		   hdr->ioff % 8U ||
+		   hdr->poff < hdr->ioff + (hdr->ndays + 1ULL) * 8U ||
+		   hdr->poff > z) {
+		/* truncated */
+		goto nope;
+	}
+
+	res = malloc(sizeof(*res));
+	res->map = map;
+	res->hdr = hdr;
+	res->mapz = z;
+	res->from = idate_to_daysi(hdr->from);
+	res->cons = (const void*)(hdr + 1U);
+	res->idx = (const void*)((const char*)map + hdr->ioff);
+	res->pairs = (const void*)((const char*)map + hdr->poff);
+	if (res->idx[hdr->ndays] > (z - hdr->poff) / sizeof(*res->pairs)) {
+		free(res);
+		goto nope;
+	}
+	return res;
+
+nope:
+	munmap(map, z);
+	return NULL;
+}
+
+DEFUN void
+free_roll_calendar(trcal_t cal)
+{
+	munmap(cal->map, cal->mapz);
+	free(cal);
+	return;
+}
+
+DEFUN trcut_t
+roll_calendar_cut(trcut_t c, trcal_t cal, idate_t dt)
+{
+	const daysi_t d = idate_to_daysi(dt);
+	uint64_t i;
+	uint64_t n;
+
+	if (UNLIKELY(d < cal->from || d - cal->from >= cal->hdr->ndays)) {
+		return NULL;
+	} else if (c != NULL) {
+		/* quickly rinse the old cut */
+		cut_rinse(c);
+	}
+	i = cal->idx[d - cal->from];
+	n = cal->idx[d - cal->from + 1U];
+	for (; i < n && i < cal->idx[cal->hdr->ndays]; i++) {
+		const struct trcal_pair_s p = cal->pairs[i];
+		int32_t ym;
+
+		if (UNLIKELY(p.con >= cal->hdr->ncons)) {
+			continue;
+		}
+		ym = cal->cons[p.con];
+		c = cut_add_cc(c, (struct trcc_s){
+				.month = (uint8_t)i_to_m(ym & 0xff),
+				.year = (uint16_t)(ym >> 8U),
+				.y = p.y,
+			});
+	}
+	return c;
+}
+
 DEFUN void
 print_cut(trcut_t c, idate_t dt, struct trcut_pr_s opt)
 {
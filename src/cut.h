@@ -49,6 +49,9 @@
 #endif	/* !DECLF */
 
 typedef struct trcut_s *trcut_t;
+typedef struct trcur_s *trcur_t;
+typedef struct trcuts_s *trcuts_t;
+typedef struct trcal_s *trcal_t;
 
 #define TRCUT_LEVER	(0U)
 #define TRCUT_EDGE	(1U)
@@ -63,14 +66,80 @@ struct trcc_s {
 	};
 };
 
+/* contracts of TRCUT_NSLOT / 12 consecutive years can be looked up in
+ * constant time, others are searched for */
+#define TRCUT_NSLOT	(60U)
+
 struct trcut_s {
 	uint16_t year_off;
 	uint16_t type;
 
+	/* slot index, contract MONTH of year YBASE + K lives in slot
+	 * K * 12 + MONTH - 1, bit S of ACT is set if slot S is in use
+	 * in which case POS[S] is its index into COMPS */
+	uint16_t ybase;
+	uint64_t act;
+	uint32_t pos[TRCUT_NSLOT];
+	/* live components outside the slot window */
+	size_t nspill;
+	/* bit I of HOLE is set if COMPS[I] has been removed, NHOLE counts
+	 * all removed components, including the ones past the 64th */
+	uint64_t hole;
+	size_t nhole;
+
+	/* bumped whenever a component is added, removed or changes its
+	 * exposure, so consumers can tell whether the cut is unchanged,
+	 * CGEN is bumped only when components are added or removed */
+	size_t gen;
+	size_t cgen;
+
+	/* the components themselves, removed ones have month 0 */
+	size_t zcomps;
 	size_t ncomps;
 	struct trcc_s comps[];
 };
 
+/* exposures of many dates at once */
+struct trcuts_s {
+	size_t ndates;
+	size_t ncons;
+	/* contract of each column, the exposure slot is unused */
+	struct trcc_s *cons;
+	/* NCONS columns of NDATES exposures each, i.e. the exposure of
+	 * contract CONS[J] on the I-th date is Y[J * NDATES + I] */
+	double *y;
+};
+
+/* roll calendars, as written by write_roll_calendar(),
+ * a header, followed by NCONS contracts (YEAR << 8 | MONTH, see mmy.h),
+ * padded to 8 bytes, followed by NDAYS + 1 indices into the pairs at
+ * IOFF, followed by the (contract, exposure) pairs at POFF;
+ * the pairs of the I-th day after FROM are those from index I up to
+ * but excluding index I + 1 */
+#define TRCAL_MAGIC	"TRCL"
+#define TRCAL_VERSION	(1U)
+#define TRCAL_ENDIAN	(0x01020304U)
+
+struct trcal_hdr_s {
+	char magic[4U];
+	uint32_t version;
+	uint32_t endian;
+	/* first day as idate */
+	uint32_t from;
+	uint32_t ndays;
+	uint32_t ncons;
+	uint64_t ioff;
+	uint64_t poff;
+};
+
+struct trcal_pair_s {
+	/* index into the contracts */
+	uint32_t con;
+	/* always 0 */
+	uint32_t pad;
+	double y;
+};
+
 /* printing options */
 struct trcut_pr_s {
 	/* absolute years instead of relative ones */
@@ -84,14 +153,67 @@ struct trcut_pr_s {
 };
 
 
+/**
+ * Return the cut of SCHEMA on WHEN, rinsing and reusing the old cut if
+ * given.  This fills SCHEMA's memo, see schema.h. */
 DECLF trcut_t make_cut(trcut_t, trsch_t schema, daysi_t when);
 
+/**
+ * Return a cursor to obtain cuts of SCHEMA for ascending dates. */
+DECLF trcur_t make_cut_cursor(trsch_t schema);
+
+/**
+ * Free resources associated with the cut cursor, including its cut. */
+DECLF void free_cut_cursor(trcur_t);
+
+/**
+ * Advance cursor to WHEN and return its cut, like make_cut() but only
+ * do work for clines whose node pairs change between the last date and
+ * WHEN.  Dates before the last date are allowed but reset the cursor. */
+DECLF trcut_t cut_cursor_advance(trcur_t, daysi_t when);
+
+/**
+ * Evaluate SCHEMA on the N dates in WHEN and return the exposure matrix.
+ * Contracts that aren't part of the cut on a date have exposure 0 there.
+ * Blocks of ascending dates are evaluated in one go. */
+DECLF trcuts_t make_cuts(trsch_t schema, const daysi_t *when, size_t n);
+
+/**
+ * Free resources associated with an exposure matrix. */
+DECLF void free_cuts(trcuts_t);
+
+/**
+ * Evaluate SCHEMA on every day from FROM till TILL (inclusive) and write
+ * the non-zero exposures as binary roll calendar to WHITHER.
+ * Return 0 on success, -1 otherwise. */
+DECLF int
+write_roll_calendar(trsch_t schema, idate_t from, idate_t till, FILE*);
+
+/**
+ * Map the roll calendar in FILE as written by write_roll_calendar().
+ * Return NULL if FILE is no roll calendar or is from a host of
+ * different byte order. */
+DECLF trcal_t read_roll_calendar(const char *file);
+
+/**
+ * Unmap the roll calendar. */
+DECLF void free_roll_calendar(trcal_t);
+
+/**
+ * Return the cut on DT as per CAL, reusing C if non-NULL,
+ * or NULL if DT is outside the calendar. */
+DECLF trcut_t roll_calendar_cut(trcut_t c, trcal_t cal, idate_t dt);
+
 /**
  * Free resources associated with the cut. */
 DECLF void free_cut(trcut_t);
 
 DECLF trcut_t cut_add_cc(trcut_t c, struct trcc_s cc);
 
+/**
+ * Set the exposures of all components in C to 0. */
+DECLF void cut_rinse(trcut_t c);
+
 DECLF void cut_rem_cc(trcut_t c, struct trcc_s *cc);
 
 DECLF void print_cut(trcut_t c, idate_t dt, struct trcut_pr_s);
@@ -224,13 +224,13 @@ dt_strp(const char *str)
 	res.H = tmp;
 
 	/* minute */
-	if ((tmp = strtoi_lim(++sp, &sp, 0, 59)) < 0 || *sp++ != ':') {
+	if ((tmp = strtoi_lim(sp, &sp, 0, 59)) < 0 || *sp++ != ':') {
 		return nul;
 	}
 	res.M = tmp;
 
 	/* second, allow leap second too */
-	if ((tmp = strtoi_lim(++sp, &sp, 0, 60)) < 0) {
+	if ((tmp = strtoi_lim(sp, &sp, 0, 60)) < 0) {
 		return nul;
 	}
 	res.S = tmp;
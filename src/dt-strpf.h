@@ -136,39 +136,51 @@ trod_inst_0_p(trod_instant_t x)
 	return x.u == 0U;
 }
 
+/**
+ * Pack X into a key that orders like X does chronologically. */
+static inline __attribute__((pure)) uint64_t
+trod_inst_key(trod_instant_t x)
+{
+	return (uint64_t)x.y << 48U | (uint64_t)x.m << 40U |
+		(uint64_t)x.d << 32U | (uint64_t)x.H << 24U |
+		(uint64_t)x.M << 16U | (uint64_t)x.S << 10U | x.ms;
+}
+
+/**
+ * Unpack a key as obtained by trod_inst_key(). */
+static inline __attribute__((pure)) trod_instant_t
+trod_key_inst(uint64_t k)
+{
+	return (trod_instant_t){
+		.y = (uint32_t)(k >> 48U),
+		.m = (uint32_t)(k >> 40U) & 0xffU,
+		.d = (uint32_t)(k >> 32U) & 0xffU,
+		.H = (uint32_t)(k >> 24U) & 0xffU,
+		.M = (uint32_t)(k >> 16U) & 0xffU,
+		.S = (uint32_t)(k >> 10U) & 0x3fU,
+		.ms = (uint32_t)k & 0x3ffU,
+	};
+}
+
 static inline __attribute__((pure)) bool
 trod_inst_lt_p(trod_instant_t x, trod_instant_t y)
 {
-	return (x.y < y.y || x.y == y.y &&
-		(x.m < y.m || x.m == y.m &&
-		 (x.d < y.d || x.d == y.d &&
-		  (x.H < y.H || x.H == y.H &&
-		   (x.M < y.M || x.M == y.M &&
-		    (x.S < y.S || x.S == y.S &&
-		     (x.ms < y.ms)))))));
+	return trod_inst_key(x) < trod_inst_key(y);
 }
 
 static inline __attribute__((pure)) bool
 trod_inst_le_p(trod_instant_t x, trod_instant_t y)
 {
-	return !(x.y > y.y || x.y == y.y &&
-		 (x.m > y.m || x.m == y.m &&
-		  (x.d > y.d || x.d == y.d &&
-		   (x.H > y.H || x.H == y.H &&
-		    (x.M > y.M || x.M == y.M &&
-		     (x.S > y.S || x.S == y.S &&
-		      (x.ms > y.ms)))))));
+	return trod_inst_key(x) <= trod_inst_key(y);
 }
 
 static inline __attribute__((pure)) bool
 trod_inst_eq_p(trod_instant_t x, trod_instant_t y)
 {
-	return x.y == y.y && x.m == y.m && x.d == y.d &&
-		x.H == y.H && x.M == y.M && x.S == y.S &&
-		x.ms == y.ms;
+	return x.u == y.u;
 }
 
-
+
 #define TROD_ALL_DAY	(0xffU)
 #define TROD_ALL_SEC	(0x3ffU)
 
@@ -184,4 +196,18 @@ trod_instant_all_sec_p(trod_instant_t i)
 	return i.ms == TROD_ALL_SEC;
 }
 
+/**
+ * Like trod_inst_key() but all-day and all-second instants key as the
+ * start of their day or second, which is when events at X take effect. */
+static inline __attribute__((pure)) uint64_t
+trod_inst_ev_key(trod_instant_t x)
+{
+	if (trod_instant_all_day_p(x)) {
+		x.H = x.M = x.S = x.ms = 0U;
+	} else if (trod_instant_all_sec_p(x)) {
+		x.ms = 0U;
+	}
+	return trod_inst_key(x);
+}
+
 #endif	/* INCLUDED_dt_strpf_h_ */
@@ -39,8 +39,8 @@
 #endif	/* HAVE_CONFIG_H */
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
-#include <sys/mman.h>
 #include "gbs.h"
 
 #if !defined LIKELY
@@ -53,172 +53,194 @@
 # define UNUSED(_x)	_x __attribute__((unused))
 #endif	/* !UNUSED */
 
-#if !defined MAP_ANON && defined MAP_ANONYMOUS
-# define MAP_ANON	MAP_ANONYMOUS
-#elif defined MAP_ANON
-/* all's good */
-#else  /* !MAP_ANON && !MAP_ANONYMOUS */
-# define MAP_ANON	(0U)
-#endif	/* !MAP_ANON && MAP_ANONYMOUS */
-
-#if !defined MAP_MEM
-# define MAP_MEM	(MAP_ANON | MAP_PRIVATE)
-#endif	/* !MAP_MEM */
-#if !defined PROT_MEM
-# define PROT_MEM	(PROT_READ | PROT_WRITE)
-#endif	/* !PROT_MEM */
+#define GBS_WBITS	(64U)
 
 /* private view on things */
 struct __gbs_s {
 	size_t nbits;
-	void *bits;
+	union {
+		uint64_t inl[GBS_NINL];
+		uint64_t *ext;
+	};
 };
 
-
+
 static inline __attribute__((const, pure)) size_t
-nmemb_to_nbytes(size_t nmemb)
+nmemb_to_nwords(size_t nmemb)
 {
-	return (nmemb - 1U) / 8U + 1U;
+	return (nmemb - 1U) / GBS_WBITS + 1U;
 }
 
 static inline __attribute__((const, pure)) size_t
-nbytes_to_nmemb(size_t nbytes)
+nwords_to_nmemb(size_t nwords)
 {
-	return nbytes * 8U;
+	return nwords * GBS_WBITS;
 }
 
-
-/* public API */
-DEFUN void
-init_gbs(gbs_t bs, size_t ninit_members)
+static inline __attribute__((pure)) uint64_t*
+gbs_words(gbs_t bs)
 {
 	struct __gbs_s *p = (void*)bs;
-	size_t mpsz = nmemb_to_nbytes(ninit_members);
 
-	if (UNLIKELY(bs->bits != NULL)) {
-		fini_gbs(bs);
+	if (LIKELY(p->nbits <= nwords_to_nmemb(GBS_NINL))) {
+		return p->inl;
 	}
-	p->nbits = nbytes_to_nmemb(mpsz);
-	p->bits = mmap(NULL, mpsz, PROT_MEM, MAP_MEM, -1, 0);
-	return;
-}
-
-DEFUN void
-fini_gbs(gbs_t bs)
-{
-	if (LIKELY(bs->bits != NULL)) {
-		struct __gbs_s *p = (void*)bs;
-		size_t mpsz = nmemb_to_nbytes(p->nbits);
-
-		munmap(p->bits, mpsz);
-		/* reset the slots */
-		p->nbits = 0UL;
-		p->bits = NULL;
-	}
-	return;
+	return p->ext;
 }
 
 static void
 resz_gbs(gbs_t bs, size_t nnu_members)
 {
 	struct __gbs_s *p = (void*)bs;
-	size_t olsz = nmemb_to_nbytes(p->nbits);
-	size_t mpsz = nmemb_to_nbytes(nnu_members);
+	size_t olnw = p->nbits / GBS_WBITS;
+	size_t nunw = nmemb_to_nwords(nnu_members);
+	uint64_t *nu;
 
-	if (olsz >= mpsz) {
+	if (UNLIKELY(nnu_members == 0U) || olnw >= nunw) {
+		return;
+	} else if (nunw <= GBS_NINL) {
+		/* still fits inline */
+		p->nbits = nwords_to_nmemb(nunw);
 		return;
 	}
 	/* otherwise there's really work to do */
-
-#if defined MREMAP_MAYMOVE
-	p->bits = mremap(p->bits, olsz, mpsz, MREMAP_MAYMOVE);
-#else  /* !MREMAP_MAYMOVE */
-	{
-		void *nu = mmap(NULL, mpsz, PROT_MEM, MAP_MEM, -1, 0);
-		memcpy(nu, p->bits, olsz);
-		munmap(p->bits, olsz);
-		p->bits = nu;
+	if (olnw > GBS_NINL) {
+		nu = realloc(p->ext, nunw * sizeof(*nu));
+	} else {
+		nu = malloc(nunw * sizeof(*nu));
+		memcpy(nu, p->inl, olnw * sizeof(*nu));
 	}
-#endif	/* MREMAP_MAYMOVE */
-	p->nbits = nbytes_to_nmemb(mpsz);
+	memset(nu + olnw, 0, (nunw - olnw) * sizeof(*nu));
+	p->ext = nu;
+	p->nbits = nwords_to_nmemb(nunw);
 	return;
 }
 
+
+/* public API */
 DEFUN void
-gbs_set(gbs_t bs, unsigned int bit)
+init_gbs(gbs_t bs, size_t ninit_members)
 {
-	unsigned int by = bit / 8U;
-	unsigned int bb = bit % 8U;
 	struct __gbs_s *p = (void*)bs;
-	uint8_t *bits;
 
-	resz_gbs(bs, bit + 1U);
-	bits = p->bits;
-	bits[by] |= (uint8_t)(1U << bb);
+	if (UNLIKELY(bs->nbits > 0U)) {
+		fini_gbs(bs);
+	}
+	memset(p->inl, 0, sizeof(p->inl));
+	resz_gbs(bs, ninit_members);
 	return;
 }
 
 DEFUN void
-gbs_unset(gbs_t bs, unsigned int bit)
+fini_gbs(gbs_t bs)
 {
-	unsigned int by = bit / 8U;
-	unsigned int bb = bit % 8U;
 	struct __gbs_s *p = (void*)bs;
-	uint8_t *bits;
 
-	resz_gbs(bs, bit + 1U);
-	bits = p->bits;
-	bits[by] &= (uint8_t)(~(1U << bb));
+	if (UNLIKELY(p->nbits > nwords_to_nmemb(GBS_NINL))) {
+		free(p->ext);
+	}
+	/* reset the slots */
+	p->nbits = 0UL;
+	memset(p->inl, 0, sizeof(p->inl));
+	return;
+}
+
+DEFUN void
+gbs_set(gbs_t bs, unsigned int bit)
+{
+	if (UNLIKELY(bit >= bs->nbits)) {
+		resz_gbs(bs, bit + 1U);
+	}
+	gbs_words(bs)[bit / GBS_WBITS] |= 1ULL << (bit % GBS_WBITS);
+	return;
+}
+
+DEFUN void
+gbs_unset(gbs_t bs, unsigned int bit)
+{
+	if (UNLIKELY(bit >= bs->nbits)) {
+		/* unset already */
+		return;
+	}
+	gbs_words(bs)[bit / GBS_WBITS] &= ~(1ULL << (bit % GBS_WBITS));
 	return;
 }
 
 DEFUN int
 gbs_set_p(gbs_t bs, unsigned int bit)
 {
-	unsigned int by = bit / 8U;
-	unsigned int bb = bit % 8U;
-	struct __gbs_s *p = (void*)bs;
-	uint8_t *bits;
-
-	resz_gbs(bs, bit + 1U);
-	bits = p->bits;
-	return bits[by] & (1U << bb);
+	if (UNLIKELY(bit >= bs->nbits)) {
+		return 0;
+	}
+	return (gbs_words(bs)[bit / GBS_WBITS] >> (bit % GBS_WBITS)) & 1U;
 }
 
 DEFUN void
 gbs_shift_lsb(gbs_t bs, unsigned int bit)
 {
-	unsigned int by = bit / 8U;
-	unsigned int bb = bit % 8U;
-	struct __gbs_s *p = (void*)bs;
-	uint8_t *bits = p->bits;
-	unsigned int nby = bs->nbits / 8U + 1U;
-	unsigned int rby;
-	unsigned int rbb;
-	unsigned int bbmsk;
+	uint64_t *w = gbs_words(bs);
+	size_t nw = bs->nbits / GBS_WBITS;
+	unsigned int by = bit / GBS_WBITS;
+	unsigned int bb = bit % GBS_WBITS;
 
 	if (UNLIKELY(bit >= bs->nbits)) {
-		memset(bits, 0, nby);
+		memset(w, 0, nw * sizeof(*w));
+		return;
+	} else if (LIKELY(nw == 1U)) {
+		/* the 5-year window */
+		*w >>= bb;
 		return;
 	}
+	/* word-wise first, then for BB bits */
+	for (size_t i = 0; i + by < nw; i++) {
+		uint64_t lo = w[i + by] >> bb;
+		uint64_t hi = bb && i + by + 1U < nw
+			? w[i + by + 1U] << (GBS_WBITS - bb) : 0U;
 
-	/* change the meaning of nby */
-	rby = nby - by;
-	rbb = 8 - bb;
-	bbmsk = (1U << bb) - 1U;
-	/* otherwise we start at 8BY and shift byte-wise first, then go
-	 * bitwise for BB bits, i.e.
-	 * 9876 54321098 76543210  by 11
-	 * 9876 54321098
-	 * 9 87654321 */
-	memmove(bits, bits + by, rby);
-	memset(bits + rby, 0, by);
-	/* now bitwise */
-	for (size_t i = 0; i < rby; i++) {
-		bits[i] >>= bb;
-		bits[i] |= (uint8_t)((bits[i + 1] & bbmsk) << rbb);
+		w[i] = lo | hi;
 	}
+	memset(w + nw - by, 0, by * sizeof(*w));
+	return;
+}
+
+DEFUN void
+gbs_clear(gbs_t bs)
+{
+	memset(gbs_words(bs), 0, bs->nbits / GBS_WBITS * sizeof(uint64_t));
 	return;
 }
 
+DEFUN int
+gbs_next_set(gbs_t bs, unsigned int bit)
+{
+	const uint64_t *w = gbs_words(bs);
+	size_t nw = bs->nbits / GBS_WBITS;
+	size_t i = bit / GBS_WBITS;
+	uint64_t x;
+
+	if (UNLIKELY(bit >= bs->nbits)) {
+		return -1;
+	}
+	/* mask off the bits before BIT */
+	for (x = w[i] & (~0ULL << (bit % GBS_WBITS)); !x; x = w[i]) {
+		if (++i >= nw) {
+			return -1;
+		}
+	}
+	return (int)(i * GBS_WBITS) + __builtin_ctzll(x);
+}
+
+DEFUN size_t
+gbs_popcnt(gbs_t bs)
+{
+	const uint64_t *w = gbs_words(bs);
+	size_t nw = bs->nbits / GBS_WBITS;
+	size_t res = 0U;
+
+	for (size_t i = 0; i < nw; i++) {
+		res += __builtin_popcountll(w[i]);
+	}
+	return res;
+}
+
 /* gbs.c ends here */
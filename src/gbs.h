@@ -38,6 +38,7 @@
 #define INCLUDED_gbs_h_
 
 #include <stddef.h>
+#include <stdint.h>
 
 #if !defined DECLF
 # define DECLF		extern
@@ -49,9 +50,16 @@
 /* generic bitsets */
 typedef struct gbs_s *gbs_t;
 
+/* number of 64-bit words kept inside the bitset object itself */
+#define GBS_NINL	(1U)
+
 struct gbs_s {
 	const size_t nbits;
-	const void *bits;
+	/* words, inline if NBITS fits, on the heap otherwise */
+	const union {
+		uint64_t inl[GBS_NINL];
+		uint64_t *ext;
+	};
 };
 
 DECLF void init_gbs(gbs_t, size_t ninit_members);
@@ -73,4 +81,17 @@ DECLF int gbs_set_p(gbs_t, unsigned int bit);
  * Shift GBS LSB-wards by X bits. */
 DECLF void gbs_shift_lsb(gbs_t, unsigned int bit);
 
+/**
+ * Unset all bits in GBS. */
+DECLF void gbs_clear(gbs_t);
+
+/**
+ * Return the index of the first set bit in GBS at or after BIT,
+ * or -1 if there is none. */
+DECLF int gbs_next_set(gbs_t, unsigned int bit);
+
+/**
+ * Return the number of set bits in GBS. */
+DECLF size_t gbs_popcnt(gbs_t);
+
 #endif	/* INCLUDED_gbs_h_ */
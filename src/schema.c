@@ -40,6 +40,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "truffle.h"
 #include "schema.h"
@@ -62,6 +67,9 @@
 #if !defined UNUSED
 # define UNUSED(_x)	_x __attribute__((unused))
 #endif	/* !UNUSED */
+#if !defined countof
+# define countof(x)	(sizeof(x) / sizeof(*(x)))
+#endif	/* !countof */
 
 typedef struct cline_s *cline_t;
 
@@ -75,6 +83,16 @@ struct cnode_s {
 /* a single line */
 #define DFLT_FROM	(101)
 #define DFLT_TILL	(1048576)
+
+/* rule nodes, i.e. nodes relative to the last trade date of a contract,
+ * their X slot holds RULE_BIT, possibly RULE_BDAY for offsets in business
+ * days rather than calendar days, the offset in the lower 16 bits, and
+ * if the contract isn't the cline's own its month (bits 16 to 19) and
+ * its year offset (bits 20 to 27, biased by 128) */
+#define RULE_BIT	(0x80000000U)
+#define RULE_BDAY	(0x40000000U)
+#define RULE_MO(x)	(((x) >> 16U) & 0xfU)
+#define RULE_YOFF(x)	((int)(((x) >> 20U) & 0xffU) - 128)
 struct cline_s {
 	daysi_t valid_from;
 	daysi_t valid_till;
@@ -84,12 +102,92 @@ struct cline_s {
 	struct cnode_s n[];
 };
 
+/* validity index,
+ * the time axis is cut into elementary segments at every valid_from and
+ * every day past a valid_till, so that the set of valid clines is constant
+ * across a segment; segment I covers [SEG[I], SEG[I + 1]) and the clines
+ * valid across it are CL[OFF[I]] up to CL[OFF[I + 1]] (exclusive) */
+struct trvix_s {
+	size_t nseg;
+	daysi_t *seg;
+	size_t *off;
+	unsigned int cl[];
+};
+
+/* memo of cuts relative to their year,
+ * since the set of valid clines is constant across a validity segment
+ * the shape of a cut within a segment only depends on the day of the year
+ * and whether the year is a leap year; entries keep, for every cline
+ * valid in segment SEG, the node pair bracketing the day in question
+ * (or NN - 1 if none does) and the interpolated exposure */
+struct trmemo_ent_s {
+	size_t seg;
+	size_t ncl;
+	struct {
+		unsigned int j;
+		unsigned int inp;
+		double y;
+	} cl[];
+};
+
+struct trmemo_s {
+	struct trmemo_ent_s *e[2U][367U];
+};
+
 /* schema */
 struct trsch_s {
 	size_t np;
+	struct trvix_s *vix;
+	struct trmemo_s *memo;
+	/* if non-NULL the clines live in this read-only map */
+	void *map;
+	size_t mapsz;
+	/* calendar files the schema was expanded with, each one
+	 * \0-terminated, DEPSZ bytes in total, part of MAP if mapped */
+	char *deps;
+	size_t depsz;
 	struct cline_s *p[];
 };
 
+/* compiled schemas,
+ * a header, followed by the offsets of the NP clines, followed by
+ * the clines themselves in their in-memory layout, each aligned to 8,
+ * followed by DEPSZ bytes of calendar file names at DOFF, see trsch_s */
+#define TRSC_MAGIC	"TRSC"
+#define TRSC_VERSION	(2U)
+#define TRSC_ENDIAN	(0x01020304U)
+#define TRSC_SUFFIX	".trsc"
+
+struct trsc_hdr_s {
+	char magic[4U];
+	uint32_t version;
+	/* sizes of our structs, a cheap check for compatible layouts */
+	uint16_t clsz;
+	uint16_t cnsz;
+	uint32_t endian;
+	uint64_t np;
+	uint64_t fsz;
+	uint64_t doff;
+	uint64_t depsz;
+	uint64_t off[];
+};
+
+/* schema library, a read-only map of the library file and an index
+ * of its sections, sorted by name, BEG and END being offsets into BUF */
+struct trsch_lib_s {
+	char *buf;
+	size_t bsz;
+	/* where calendar files are looked up */
+	char *dir;
+	size_t nsec;
+	struct trsch_sec_s {
+		const char *name;
+		size_t nlen;
+		size_t beg;
+		size_t end;
+	} sec[];
+};
+
 
 
 /* standalone version, we could use ds_sum but this is most likely
@@ -171,10 +269,21 @@ cline_add_sugar(cline_t cl, idate_t x, double y)
 	idx = cl->nn++;
 	cl->n[idx].x = x;
 	cl->n[idx].y = y;
-	cl->n[idx].l = daysi_sans_year(x);
+	cl->n[idx].l = !(x & RULE_BIT) ? daysi_sans_year(x) : 0U;
 	return cl;
 }
 
+static bool
+cline_rule_p(const struct cline_s *cl)
+{
+	for (size_t j = 0; j < cl->nn; j++) {
+		if (cl->n[j].x & RULE_BIT) {
+			return true;
+		}
+	}
+	return false;
+}
+
 static trsch_t
 sch_add_cl(trsch_t s, struct cline_s *cl)
 {
@@ -183,6 +292,12 @@ sch_add_cl(trsch_t s, struct cline_s *cl)
 		size_t new = sizeof(*s) + CL_STEP * sizeof(*s->p);
 		s = malloc(new);
 		s->np = 0;
+		s->vix = NULL;
+		s->memo = NULL;
+		s->map = NULL;
+		s->mapsz = 0U;
+		s->deps = NULL;
+		s->depsz = 0U;
 	} else if ((s->np % CL_STEP) == 0) {
 		size_t new = sizeof(*s) + (s->np + CL_STEP) * sizeof(*s->p);
 		s = realloc(s, new);
@@ -192,6 +307,159 @@ sch_add_cl(trsch_t s, struct cline_s *cl)
 	return s;
 }
 
+static int
+daysi_cmp(const void *x, const void *y)
+{
+	const daysi_t *dx = x;
+	const daysi_t *dy = y;
+
+	return (*dx > *dy) - (*dx < *dy);
+}
+
+static size_t
+vix_find_seg(const daysi_t *seg, size_t nseg, daysi_t when)
+{
+/* return the index of the segment containing WHEN, or NSEG */
+	size_t lo = 0U;
+	size_t hi = nseg;
+
+	if (UNLIKELY(!nseg || when < seg[0U] || when >= seg[nseg])) {
+		return nseg;
+	}
+	/* seg[lo] <= when < seg[hi] */
+	while (hi - lo > 1U) {
+		size_t mid = (lo + hi) / 2U;
+
+		if (seg[mid] <= when) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+static void
+sch_make_vix(trsch_t s)
+{
+	struct trvix_s *res;
+	daysi_t *bp;
+	size_t nbp;
+	size_t *cnt;
+	size_t ncl;
+
+	if (s->vix != NULL) {
+		free(s->vix->seg);
+		free(s->vix->off);
+		free(s->vix);
+	}
+
+	/* collect break points */
+	bp = malloc(2U * s->np * sizeof(*bp));
+	for (size_t i = 0; i < s->np; i++) {
+		bp[2U * i + 0U] = s->p[i]->valid_from;
+		bp[2U * i + 1U] = s->p[i]->valid_till + 1U;
+	}
+	qsort(bp, 2U * s->np, sizeof(*bp), daysi_cmp);
+	nbp = 0U;
+	for (size_t i = 0; i < 2U * s->np; i++) {
+		if (!nbp || bp[i] != bp[nbp - 1U]) {
+			bp[nbp++] = bp[i];
+		}
+	}
+
+	/* count the clines per segment, then lay them out */
+	cnt = calloc(nbp, sizeof(*cnt));
+	ncl = 0U;
+	for (size_t i = 0; i < s->np; i++) {
+		const struct cline_s *p = s->p[i];
+		size_t s0 = vix_find_seg(bp, nbp - 1U, p->valid_from);
+
+		for (size_t j = s0; j < nbp - 1U && bp[j] <= p->valid_till; j++) {
+			cnt[j + 1U]++;
+			ncl++;
+		}
+	}
+	for (size_t j = 1U; j < nbp; j++) {
+		cnt[j] += cnt[j - 1U];
+	}
+
+	res = malloc(sizeof(*res) + ncl * sizeof(*res->cl));
+	res->nseg = nbp - 1U;
+	res->seg = bp;
+	res->off = cnt;
+	for (size_t i = 0; i < s->np; i++) {
+		const struct cline_s *p = s->p[i];
+		size_t s0 = vix_find_seg(bp, nbp - 1U, p->valid_from);
+
+		/* we misuse OFF[J] as fill pointer for segment J,
+		 * it will have moved to the start of segment J + 1 when done */
+		for (size_t j = s0; j < nbp - 1U && bp[j] <= p->valid_till; j++) {
+			res->cl[cnt[j]++] = i;
+		}
+	}
+	/* shift the fill pointers back into place */
+	memmove(cnt + 1U, cnt, (nbp - 1U) * sizeof(*cnt));
+	cnt[0U] = 0U;
+
+	s->vix = res;
+	return;
+}
+
+static idate_t
+read_rule(const char *str, char **restrict ptr)
+{
+/* rules look like LTD-5b (business days) or LTD+2 (calendar days),
+ * relative to the last trade date of the cline's contract, or like
+ * LTD[H0]-5b relative to the last trade date of another contract */
+	idate_t res = RULE_BIT;
+	long int off = 0;
+	const char *sp;
+
+	if (strncasecmp(str, "LTD", 3U)) {
+		return 0U;
+	}
+	sp = str + 3U;
+	if (*sp == '[') {
+		unsigned int mo;
+		long int yoff;
+		char *tmp;
+
+		if (!(mo = m_to_i(*++sp))) {
+			return 0U;
+		}
+		yoff = strtol(++sp, &tmp, 10);
+		if (*tmp != ']' || yoff < -128 || yoff > 127) {
+			return 0U;
+		}
+		res |= mo << 16U | (unsigned int)(yoff + 128) << 20U;
+		sp = tmp + 1U;
+	}
+	if (*sp == '+' || *sp == '-') {
+		char *tmp;
+
+		off = strtol(sp, &tmp, 10);
+		if (off < INT16_MIN || off > INT16_MAX) {
+			return 0U;
+		}
+		sp = tmp;
+	}
+	switch (*sp) {
+	case 'b': case 'B':
+		res |= RULE_BDAY;
+		sp++;
+		break;
+	case 'd': case 'D':
+		sp++;
+		break;
+	default:
+		break;
+	}
+	/* we're pointing into STR */
+	*ptr = (char*)(uintptr_t)sp;
+	return res | (uint16_t)off;
+}
+
 static cline_t
 __read_schema_line(const char *line, size_t llen)
 {
@@ -232,7 +500,12 @@ __read_schema_line(const char *line, size_t llen)
 		do {
 			daysi_t ddt;
 
-			if (!(dt = read_date(p, &tmp) % 10000U)) {
+			if (isalpha(*p)) {
+				/* resolved when the rules get expanded */
+				if (!(dt = read_rule(p, &tmp))) {
+					goto nope;
+				}
+			} else if (!(dt = read_date(p, &tmp) % 10000U)) {
 				goto nope;
 			}
 			p = tmp + strspn(tmp, skip);
@@ -244,9 +517,11 @@ __read_schema_line(const char *line, size_t llen)
 					cl = cline_add_sugar(cl, 101, v);
 				}
 			}
-			/* add this line */
-			ddt = daysi_sans_year(dt);
-			if (cl->nn && ddt <= cl->n[cl->nn - 1].l) {
+			/* add this line, rule nodes (with L slot 0) are
+			 * checked when the rules get expanded */
+			ddt = !(dt & RULE_BIT) ? daysi_sans_year(dt) : 0U;
+			if (cl->nn && ddt && cl->n[cl->nn - 1].l &&
+			    ddt <= cl->n[cl->nn - 1].l) {
 				__err_not_asc(line, llen);
 				goto nope;
 			}
@@ -365,6 +640,532 @@ print_cline(cline_t cl, FILE *whither)
 }
 
 
+static char*
+file_dir(const char *file)
+{
+/* return the directory part of FILE, or NULL if there is none */
+	const char *sl;
+	char *res;
+
+	if ((sl = strrchr(file, '/')) == NULL) {
+		return NULL;
+	} else if (sl == file) {
+		return strdup("/");
+	}
+	res = malloc(sl - file + 1U);
+	memcpy(res, file, sl - file);
+	res[sl - file] = '\0';
+	return res;
+}
+
+/* rules and the local calendars they need */
+struct trrules_s {
+	/* directory to resolve relative calendar file names against */
+	const char *dir;
+	/* non-business days other than weekends, sorted */
+	size_t nhol;
+	daysi_t *hol;
+	/* last trade dates */
+	size_t nexp;
+	struct trexp_s {
+		trym_t ym;
+		daysi_t ltd;
+	} *exp;
+	/* clines with rule nodes */
+	size_t ntpl;
+	cline_t *tpl;
+	/* calendar files read, as in trsch_s */
+	char *deps;
+	size_t depsz;
+};
+
+static int
+exp_cmp(const void *x, const void *y)
+{
+	const struct trexp_s *ex = x;
+	const struct trexp_s *ey = y;
+
+	return ex->ym < ey->ym ? -1 : ex->ym > ey->ym;
+}
+
+static void
+rules_add_dep(struct trrules_s *r, const char *path)
+{
+/* remember PATH, absolute if possible, as calendar file of R */
+	char *abs = realpath(path, NULL);
+	const char *p = abs ?: path;
+	size_t z = strlen(p) + 1U;
+
+	r->deps = realloc(r->deps, r->depsz + z);
+	memcpy(r->deps + r->depsz, p, z);
+	r->depsz += z;
+	free(abs);
+	return;
+}
+
+static FILE*
+rules_fopen(struct trrules_s *r, const char *fn)
+{
+	FILE *res;
+
+	if (*fn != '/' && r->dir != NULL) {
+		size_t dz = strlen(r->dir);
+		size_t fz = strlen(fn);
+		char path[dz + 1U + fz + 1U];
+
+		memcpy(path, r->dir, dz);
+		path[dz] = '/';
+		memcpy(path + dz + 1U, fn, fz + 1U);
+		if ((res = fopen(path, "r")) != NULL) {
+			rules_add_dep(r, path);
+		}
+		return res;
+	}
+	if ((res = fopen(fn, "r")) != NULL) {
+		rules_add_dep(r, fn);
+	}
+	return res;
+}
+
+static void
+rules_directive(struct trrules_s *r, const char *line, size_t llen)
+{
+/* directives look like
+ * @holidays FILE   one date per line
+ * @expiries FILE   one contract and its last trade date per line */
+	static const char skip[] = " \t";
+	size_t kz = strcspn(line, skip);
+	const char *fp = line + kz + strspn(line + kz, skip);
+	size_t fz = llen - (fp - line);
+	char fn[fz + 1U];
+	char *ln = NULL;
+	size_t lz = 0U;
+	ssize_t nrd;
+	FILE *f;
+	bool holp;
+
+	if (kz == 9U && !strncmp(line, "@holidays", kz)) {
+		holp = true;
+	} else if (kz == 9U && !strncmp(line, "@expiries", kz)) {
+		holp = false;
+	} else {
+		return;
+	}
+	/* trim the file name */
+	for (; fz > 0U && isspace(fp[fz - 1U]); fz--);
+	memcpy(fn, fp, fz);
+	fn[fz] = '\0';
+	if ((f = rules_fopen(r, fn)) == NULL) {
+		fprintf(stderr, "unable to open file %s\n", fn);
+		return;
+	}
+	while ((nrd = getline(&ln, &lz, f)) > 0) {
+		const char *lp = ln + strspn(ln, skip);
+		char *tmp;
+
+		if (*lp == '#' || *lp == '\n') {
+			continue;
+		} else if (holp) {
+			idate_t d = read_date(lp, NULL);
+
+			if (d == 0U) {
+				continue;
+			}
+			if ((r->nhol % 256U) == 0U) {
+				size_t nu = r->nhol + 256U;
+				r->hol = realloc(r->hol, nu * sizeof(*r->hol));
+			}
+			r->hol[r->nhol++] = idate_to_daysi(d);
+		} else {
+			const char *cp;
+			trym_t ym = read_trym(lp, &cp);
+			idate_t d;
+
+			if (!ym || !trym_mo(ym) ||
+			    !(d = read_date(cp + strspn(cp, skip), &tmp))) {
+				continue;
+			}
+			if ((r->nexp % 64U) == 0U) {
+				size_t nu = r->nexp + 64U;
+				r->exp = realloc(r->exp, nu * sizeof(*r->exp));
+			}
+			r->exp[r->nexp].ym = ym;
+			r->exp[r->nexp].ltd = idate_to_daysi(d);
+			r->nexp++;
+		}
+	}
+	if (ln != NULL) {
+		free(ln);
+	}
+	fclose(f);
+	if (holp) {
+		qsort(r->hol, r->nhol, sizeof(*r->hol), daysi_cmp);
+	} else {
+		qsort(r->exp, r->nexp, sizeof(*r->exp), exp_cmp);
+	}
+	return;
+}
+
+static daysi_t
+rules_ltd(const struct trrules_s *r, trym_t ym)
+{
+/* return the last trade date of YM, or 0 if unknown */
+	const struct trexp_s key = {.ym = ym};
+	const struct trexp_s *e;
+
+	e = bsearch(&key, r->exp, r->nexp, sizeof(*r->exp), exp_cmp);
+	return e ? e->ltd : 0U;
+}
+
+static bool
+rules_bday_p(const struct trrules_s *r, daysi_t d)
+{
+/* day 1 is a Monday */
+	switch (d % 7U) {
+	case 0U:
+	case 6U:
+		return false;
+	default:
+		break;
+	}
+	return bsearch(&d, r->hol, r->nhol, sizeof(*r->hol), daysi_cmp) == NULL;
+}
+
+static daysi_t
+rules_resolve(const struct trrules_s *r, idate_t x, daysi_t ltd)
+{
+	int off = (int16_t)(x & 0xffffU);
+	daysi_t res = ltd;
+
+	if (!(x & RULE_BDAY)) {
+		return ltd + off;
+	}
+	for (int step = off < 0 ? -1 : 1; off; res += step) {
+		if (rules_bday_p(r, res + step)) {
+			off -= step;
+		}
+	}
+	return res;
+}
+
+static trsch_t
+sch_add_line(trsch_t s, struct trrules_s *r, const char *line, size_t llen)
+{
+	cline_t cl;
+
+	if (*line == '@') {
+		rules_directive(r, line, llen);
+	} else if ((cl = read_schema_line(line, llen)) == NULL) {
+		;
+	} else if (cline_rule_p(cl)) {
+		/* keep for later */
+		if ((r->ntpl % 16U) == 0U) {
+			size_t nu = r->ntpl + 16U;
+			r->tpl = realloc(r->tpl, nu * sizeof(*r->tpl));
+		}
+		r->tpl[r->ntpl++] = cl;
+	} else {
+		s = sch_add_cl(s, cl);
+	}
+	return s;
+}
+
+static double
+nodes_interp(const daysi_t *d, const double *y, size_t n, daysi_t when)
+{
+/* interpolate the polygon D/Y at WHEN, D[0] <= WHEN <= D[N - 1] */
+	size_t j;
+
+	for (j = 1U; j < n - 1U && d[j] < when; j++);
+	return y[j - 1U] +
+		(double)(when - d[j - 1U]) * (y[j] - y[j - 1U]) /
+		(double)(d[j] - d[j - 1U]);
+}
+
+static trsch_t
+sch_expand_rules(trsch_t s, const struct trrules_s *r)
+{
+/* turn every cline with rule nodes into one cline per year and contract
+ * listed in the expiries, the nodes of a contract may well spread over
+ * two or more years in which case the polygon is split at the year
+ * boundaries and the year offsets are adapted */
+	for (size_t i = 0; i < r->ntpl; i++) {
+		const struct cline_s *t = r->tpl[i];
+		unsigned int mo = m_to_i(t->month);
+		daysi_t d[t->nn];
+		double y[t->nn];
+
+		for (size_t k = 0; k < r->nexp; k++) {
+			int cy = trym_yr(r->exp[k].ym);
+			int ey = cy - t->year_off;
+			int y0;
+			int y1;
+
+			if (trym_mo(r->exp[k].ym) != mo) {
+				continue;
+			}
+			for (size_t j = 0; j < t->nn; j++) {
+				idate_t x = t->n[j].x;
+				daysi_t ltd = r->exp[k].ltd;
+
+				if (!(x & RULE_BIT)) {
+					d[j] = daysi_in_year(t->n[j].l, ey);
+				} else if (RULE_MO(x) &&
+					   !(ltd = rules_ltd(r, cym_to_trym(
+						     ey + RULE_YOFF(x),
+						     RULE_MO(x))))) {
+					/* no expiry for that contract */
+					goto next;
+				} else {
+					d[j] = rules_resolve(r, x, ltd);
+				}
+				y[j] = t->n[j].y;
+				if (j && d[j] <= d[j - 1U]) {
+					fprintf(stderr, "\
+error: %c%d rule dates are not in ascending order\n",
+						t->month, cy);
+					goto next;
+				}
+			}
+			y0 = daysi_to_year(d[0U]);
+			y1 = daysi_to_year(d[t->nn - 1U]);
+			for (int yk = y0; yk <= y1; yk++) {
+				daysi_t j0 = idate_to_daysi(yk * 10000U + 101U);
+				daysi_t j1 = idate_to_daysi(yk * 10000U + 1231U);
+				daysi_t vf = t->valid_from > j0 ? t->valid_from : j0;
+				daysi_t vt = t->valid_till < j1 ? t->valid_till : j1;
+				daysi_t last = 0U;
+				cline_t cl;
+
+				if (vf > vt ||
+				    (cl = make_cline(t->month, cy - yk)) == NULL) {
+					continue;
+				}
+				if (d[0U] < j0) {
+					double v = nodes_interp(d, y, t->nn, j0);
+					cl = cline_add_sugar(cl, 101U, v);
+					last = j0;
+				}
+				for (size_t j = 0; j < t->nn; j++) {
+					idate_t x;
+
+					if (d[j] < j0 || d[j] > j1 || d[j] == last) {
+						continue;
+					}
+					x = daysi_to_idate(d[j]) % 10000U;
+					cl = cline_add_sugar(cl, x, y[j]);
+					last = d[j];
+				}
+				if (d[t->nn - 1U] > j1 && last != j1) {
+					double v = nodes_interp(d, y, t->nn, j1);
+					cl = cline_add_sugar(cl, 1231U, v);
+				}
+				cl->valid_from = vf;
+				cl->valid_till = vt;
+				s = sch_add_cl(s, cl);
+			}
+		next:
+			;
+		}
+	}
+	return s;
+}
+
+static void
+free_rules(struct trrules_s *r)
+{
+	for (size_t i = 0; i < r->ntpl; i++) {
+		free(r->tpl[i]);
+	}
+	free(r->tpl);
+	free(r->hol);
+	free(r->exp);
+	free(r->deps);
+	return;
+}
+
+static void
+sch_take_deps(trsch_t s, struct trrules_s *r)
+{
+/* hand the calendar files of R over to S */
+	if (s != NULL && r->depsz) {
+		s->deps = r->deps;
+		s->depsz = r->depsz;
+		r->deps = NULL;
+		r->depsz = 0U;
+	}
+	return;
+}
+
+static trsch_t
+read_schema_bin(const char *file)
+{
+/* map compiled schema FILE, return NULL if FILE isn't one of ours */
+	const struct trsc_hdr_s *hdr;
+	trsch_t res = NULL;
+	struct stat st;
+	void *map;
+	int fd;
+
+	if ((fd = open(file, O_RDONLY)) < 0) {
+		return NULL;
+	} else if (fstat(fd, &st) < 0 ||
+		   (size_t)st.st_size < sizeof(*hdr)) {
+		close(fd);
+		return NULL;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return NULL;
+	}
+
+	hdr = map;
+	if (memcmp(hdr->magic, TRSC_MAGIC, sizeof(hdr->magic)) ||
+	    hdr->version != TRSC_VERSION ||
+	    hdr->endian != TRSC_ENDIAN ||
+	    hdr->clsz != sizeof(struct cline_s) ||
+	    hdr->cnsz != sizeof(struct cnode_s) ||
+	    hdr->fsz != (uint64_t)st.st_size ||
+	    hdr->np > (hdr->fsz - sizeof(*hdr)) / sizeof(*hdr->off) ||
+	    hdr->doff > hdr->fsz || hdr->depsz > hdr->fsz - hdr->doff ||
+	    (hdr->depsz &&
+	     ((const char*)map)[hdr->doff + hdr->depsz - 1U] != '\0')) {
+		goto nope;
+	}
+	/* check the clines are where they say they are */
+	for (size_t i = 0; i < hdr->np; i++) {
+		const struct cline_s *p;
+		uint64_t o = hdr->off[i];
+
+		if (o % sizeof(uint64_t) ||
+		    o > hdr->fsz - sizeof(*p)) {
+			goto nope;
+		}
+		p = (const void*)((const char*)map + o);
+		if (p->nn > (hdr->fsz - o - sizeof(*p)) / sizeof(*p->n)) {
+			goto nope;
+		}
+	}
+
+	res = malloc(sizeof(*res) + hdr->np * sizeof(*res->p));
+	res->np = hdr->np;
+	res->vix = NULL;
+	res->memo = NULL;
+	res->map = map;
+	res->mapsz = st.st_size;
+	res->deps = hdr->depsz ? (char*)map + hdr->doff : NULL;
+	res->depsz = hdr->depsz;
+	for (size_t i = 0; i < res->np; i++) {
+		res->p[i] = (void*)((char*)map + hdr->off[i]);
+	}
+	sch_make_vix(res);
+	return res;
+nope:
+	munmap(map, st.st_size);
+	return NULL;
+}
+
+static bool
+fresher_p(const struct stat *x, const struct stat *y)
+{
+/* return whether X was modified no earlier than Y */
+	return x->st_mtim.tv_sec > y->st_mtim.tv_sec ||
+		(x->st_mtim.tv_sec == y->st_mtim.tv_sec &&
+		 x->st_mtim.tv_nsec >= y->st_mtim.tv_nsec);
+}
+
+static bool
+deps_fresh_p(trsch_t s, const struct stat *st)
+{
+/* return whether all calendar files of S were modified no later than ST */
+	for (size_t i = 0; i < s->depsz; i += strlen(s->deps + i) + 1U) {
+		struct stat dst;
+
+		if (stat(s->deps + i, &dst) < 0 || !fresher_p(st, &dst)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static trsch_t
+read_schema_mem(const char *buf, size_t bsz, const char *dir)
+{
+/* like read_schema() but take the lines from BUF,
+ * calendar files are looked up in DIR */
+	const char *const ep = buf + bsz;
+	struct trrules_s r = {.dir = dir};
+	trsch_t res = NULL;
+
+	for (const char *bp = buf, *eol; bp < ep; bp = eol + 1U) {
+		char tmp[4096U];
+		const char *line = bp;
+		size_t llen;
+
+		if ((eol = memchr(bp, '\n', ep - bp)) == NULL) {
+			/* last line lacks its newline, give it one */
+			if ((llen = ep - bp) >= sizeof(tmp) - 1U) {
+				break;
+			}
+			memcpy(tmp, bp, llen);
+			tmp[llen++] = '\n';
+			tmp[llen] = '\0';
+			line = tmp;
+			eol = ep;
+		} else {
+			llen = eol - bp + 1U;
+		}
+		res = sch_add_line(res, &r, line, llen);
+	}
+	res = sch_expand_rules(res, &r);
+	sch_take_deps(res, &r);
+	free_rules(&r);
+	if (res != NULL) {
+		sch_make_vix(res);
+	}
+	return res;
+}
+
+
+/* schema libraries */
+static int
+sec_cmp(const void *a, const void *b)
+{
+	const struct trsch_sec_s *x = a;
+	const struct trsch_sec_s *y = b;
+	size_t n = x->nlen < y->nlen ? x->nlen : y->nlen;
+	int res;
+
+	if ((res = memcmp(x->name, y->name, n))) {
+		return res;
+	} else if (x->nlen != y->nlen) {
+		return x->nlen < y->nlen ? -1 : 1;
+	}
+	/* first occurrence wins */
+	return x->beg < y->beg ? -1 : x->beg > y->beg;
+}
+
+static trsch_lib_t
+lib_add_sec(trsch_lib_t lib, const char *name, size_t nlen, size_t beg)
+{
+	if ((lib->nsec % 64U) == 0U) {
+		size_t nu = lib->nsec + 64U;
+
+		lib = realloc(lib, sizeof(*lib) + nu * sizeof(*lib->sec));
+	}
+	if (lib->nsec) {
+		/* finish off the previous section */
+		lib->sec[lib->nsec - 1U].end = name - 1U - lib->buf;
+	}
+	lib->sec[lib->nsec].name = name;
+	lib->sec[lib->nsec].nlen = nlen;
+	lib->sec[lib->nsec].beg = beg;
+	lib->sec[lib->nsec].end = lib->bsz;
+	lib->nsec++;
+	return lib;
+}
+
 /* public API */
 DEFUN trsch_t
 read_schema(const char *file)
@@ -374,30 +1175,162 @@ read_schema(const char *file)
 	size_t llen = 0UL;
 	char *line = NULL;
 	trsch_t res = NULL;
+	struct trrules_s r = {NULL};
+	char *dir = NULL;
 	FILE *f;
 	ssize_t nrd;
 
 	if (file[0] == '-' && file[1] == '\0') {
 		f = stdin;
-	} else if ((f = fopen(file, "r")) == NULL) {
+		goto rd;
+	} else if ((res = read_schema_bin(file)) != NULL) {
+		/* FILE is a compiled schema */
+		return res;
+	} else {
+		/* try FILE.trsc if it's at least as fresh as FILE
+		 * and the calendar files it was expanded with */
+		static const char sfx[] = TRSC_SUFFIX;
+		size_t fnz = strlen(file);
+		char bfn[fnz + sizeof(sfx)];
+		struct stat st;
+		struct stat bst;
+
+		memcpy(bfn, file, fnz);
+		memcpy(bfn + fnz, sfx, sizeof(sfx));
+		if (stat(file, &st) == 0 && stat(bfn, &bst) == 0 &&
+		    fresher_p(&bst, &st) &&
+		    (res = read_schema_bin(bfn)) != NULL) {
+			if (deps_fresh_p(res, &bst)) {
+				return res;
+			}
+			/* stale, read FILE after all */
+			free_schema(res);
+			res = NULL;
+		}
+	}
+	if ((f = fopen(file, "r")) == NULL) {
 		fprintf(stderr, "unable to open file %s\n", file);
 		return NULL;
 	}
+	r.dir = dir = file_dir(file);
+rd:
 	while ((nrd = getline(&line, &llen, f)) > 0) {
-		cline_t cl;
-
-		if ((cl = read_schema_line(line, nrd))) {
-			res = sch_add_cl(res, cl);
-		}
+		res = sch_add_line(res, &r, line, nrd);
 	}
+	res = sch_expand_rules(res, &r);
+	sch_take_deps(res, &r);
+	free_rules(&r);
 
 	if (line) {
 		free(line);
 	}
+	if (dir != NULL) {
+		free(dir);
+	}
 	fclose(f);
+
+	if (res != NULL) {
+		sch_make_vix(res);
+	}
 	return res;
 }
 
+DEFUN trsch_lib_t
+open_schema_lib(const char *file)
+{
+/* libraries look like
+ * [ROOT]
+ * schema lines
+ * [ROOT]
+ * ... */
+	trsch_lib_t res;
+	struct stat st;
+	const char *bp;
+	const char *ep;
+	void *buf;
+	int fd;
+
+	if ((fd = open(file, O_RDONLY)) < 0) {
+		fprintf(stderr, "unable to open file %s\n", file);
+		return NULL;
+	} else if (fstat(fd, &st) < 0 || st.st_size <= 0) {
+		close(fd);
+		return NULL;
+	}
+	buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (buf == MAP_FAILED) {
+		return NULL;
+	}
+
+	res = calloc(1, sizeof(*res));
+	res->buf = buf;
+	res->bsz = st.st_size;
+	res->dir = file_dir(file);
+	/* index the section headers, the sections themselves are only
+	 * parsed upon request */
+	for (bp = buf, ep = bp + res->bsz; bp < ep; bp++) {
+		const char *eon;
+
+		if (*bp == '[' &&
+		    (eon = memchr(bp, ']', ep - bp)) != NULL &&
+		    memchr(bp, '\n', eon - bp) == NULL) {
+			const char *eol = memchr(eon, '\n', ep - eon);
+			size_t beg = eol ? (size_t)(eol + 1U - res->buf) : res->bsz;
+
+			res = lib_add_sec(res, bp + 1U, eon - bp - 1U, beg);
+		}
+		/* skip to the next line */
+		if ((bp = memchr(bp, '\n', ep - bp)) == NULL) {
+			break;
+		}
+	}
+	qsort(res->sec, res->nsec, sizeof(*res->sec), sec_cmp);
+	return res;
+}
+
+DEFUN void
+close_schema_lib(trsch_lib_t lib)
+{
+	munmap(lib->buf, lib->bsz);
+	if (lib->dir != NULL) {
+		free(lib->dir);
+	}
+	free(lib);
+	return;
+}
+
+DEFUN trsch_t
+read_schema_lib(trsch_lib_t lib, const char *root)
+{
+	struct trsch_sec_s key = {
+		.name = root,
+		.nlen = strlen(root),
+		.beg = 0U,
+	};
+	size_t lo = 0U;
+	size_t hi = lib->nsec;
+
+	/* find the first section named ROOT */
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2U;
+
+		if (sec_cmp(lib->sec + mid, &key) < 0) {
+			lo = mid + 1U;
+		} else {
+			hi = mid;
+		}
+	}
+	if (lo >= lib->nsec ||
+	    lib->sec[lo].nlen != key.nlen ||
+	    memcmp(lib->sec[lo].name, root, key.nlen)) {
+		return NULL;
+	}
+	return read_schema_mem(
+		lib->buf + lib->sec[lo].beg,
+		lib->sec[lo].end - lib->sec[lo].beg, lib->dir);
+}
+
 DEFUN void
 print_schema(trsch_t sch, FILE *whither)
 {
@@ -407,64 +1340,410 @@ print_schema(trsch_t sch, FILE *whither)
 	return;
 }
 
+DEFUN int
+compile_schema(trsch_t sch, const char *file)
+{
+	static const char tmpl[] = ".XXXXXX";
+	size_t fnz = strlen(file);
+	char tfn[fnz + sizeof(tmpl)];
+	struct trsc_hdr_s *hdr;
+	size_t hsz = sizeof(*hdr) + sch->np * sizeof(*hdr->off);
+	size_t fsz = hsz;
+	struct cline_s *cl = NULL;
+	size_t zcl = 0U;
+	int fd;
+	int res = 0;
+
+	hdr = malloc(hsz);
+	memcpy(hdr->magic, TRSC_MAGIC, sizeof(hdr->magic));
+	hdr->version = TRSC_VERSION;
+	hdr->clsz = sizeof(struct cline_s);
+	hdr->cnsz = sizeof(struct cnode_s);
+	hdr->endian = TRSC_ENDIAN;
+	hdr->np = sch->np;
+	for (size_t i = 0; i < sch->np; i++) {
+		const struct cline_s *p = sch->p[i];
+		size_t z = sizeof(*p) + p->nn * sizeof(*p->n);
+
+		hdr->off[i] = fsz;
+		fsz += (z + sizeof(uint64_t) - 1U) & ~(sizeof(uint64_t) - 1U);
+	}
+	hdr->doff = fsz;
+	hdr->depsz = sch->depsz;
+	hdr->fsz = fsz += sch->depsz;
+
+	/* write to a temp file first and rename, so concurrent readers
+	 * never see half a schema */
+	memcpy(tfn, file, fnz);
+	memcpy(tfn + fnz, tmpl, sizeof(tmpl));
+	if ((fd = mkstemp(tfn)) < 0) {
+		free(hdr);
+		return -1;
+	} else if (write(fd, hdr, hsz) != (ssize_t)hsz) {
+		goto nope;
+	}
+	for (size_t i = 0; i < sch->np; i++) {
+		const struct cline_s *p = sch->p[i];
+		size_t z = sizeof(*p) + p->nn * sizeof(*p->n);
+
+		z = (z + sizeof(uint64_t) - 1U) & ~(sizeof(uint64_t) - 1U);
+		if (z > zcl) {
+			cl = realloc(cl, zcl = z);
+		}
+		/* copy member by member into a zeroed buffer, P's padding
+		 * is whatever malloc() left there */
+		memset(cl, 0, z);
+		cl->valid_from = p->valid_from;
+		cl->valid_till = p->valid_till;
+		cl->month = p->month;
+		cl->year_off = p->year_off;
+		cl->nn = p->nn;
+		memcpy(cl->n, p->n, p->nn * sizeof(*p->n));
+		if (write(fd, cl, z) != (ssize_t)z) {
+			goto nope;
+		}
+	}
+	if (sch->depsz &&
+	    write(fd, sch->deps, sch->depsz) != (ssize_t)sch->depsz) {
+		goto nope;
+	}
+	{
+		/* mkstemp() gives us 0600, be like fopen() instead */
+		mode_t um = umask(0);
+
+		umask(um);
+		fchmod(fd, 0666 & ~um);
+	}
+	if (close(fd) < 0 || rename(tfn, file) < 0) {
+		unlink(tfn);
+		res = -1;
+	}
+	free(cl);
+	free(hdr);
+	return res;
+nope:
+	close(fd);
+	unlink(tfn);
+	free(cl);
+	free(hdr);
+	return -1;
+}
+
+DEFUN trsch_t
+shift_schema(trsch_t sch, int days)
+{
+/* nodes on 01-01 or 12-31 pin the year boundaries and stay put,
+ * all others are moved but kept between those and in ascending order */
+	static const daysi_t lo = 1U | DAYSI_DIY_BIT;
+	static const daysi_t hi = 366U | DAYSI_DIY_BIT;
+	trsch_t res = NULL;
+
+	for (size_t i = 0; i < sch->np; i++) {
+		const struct cline_s *p = sch->p[i];
+		size_t z = sizeof(*p) + p->nn * sizeof(*p->n);
+		struct cline_s *cl = malloc(z);
+
+		memcpy(cl, p, z);
+		for (size_t j = 0; j < cl->nn; j++) {
+			daysi_t l = cl->n[j].l;
+			int d;
+
+			if (l == lo || l == hi || !(l & DAYSI_DIY_BIT)) {
+				continue;
+			}
+			d = (int)(l & ~DAYSI_DIY_BIT) + days;
+			if (d < 2) {
+				d = 2;
+			} else if (d > 365) {
+				d = 365;
+			}
+			cl->n[j].l = (daysi_t)d | DAYSI_DIY_BIT;
+		}
+		/* clamping might have squashed nodes, spread them again */
+		for (size_t j = 1; j < cl->nn; j++) {
+			if (cl->n[j].l <= cl->n[j - 1U].l && cl->n[j].l != hi) {
+				cl->n[j].l = cl->n[j - 1U].l + 1U;
+			}
+		}
+		for (size_t j = cl->nn; j-- > 1U;) {
+			if (cl->n[j - 1U].l >= cl->n[j].l &&
+			    cl->n[j - 1U].l != lo) {
+				cl->n[j - 1U].l = cl->n[j].l - 1U;
+			}
+		}
+		/* and keep the printable dates in sync */
+		for (size_t j = 0; j < cl->nn; j++) {
+			unsigned int doy = cl->n[j].l & ~DAYSI_DIY_BIT;
+			struct md_s md = __yd_to_md((struct yd_s){2000U, doy});
+
+			cl->n[j].x = md.m * 100U + md.d;
+		}
+		res = sch_add_cl(res, cl);
+	}
+	if (res != NULL) {
+		sch_make_vix(res);
+	}
+	return res;
+}
+
 DEFUN void
 free_schema(trsch_t sch)
 {
-	for (size_t i = 0; i < sch->np; i++) {
-		free(sch->p[i]);
+	if (sch->map != NULL) {
+		/* clines and deps are part of the map */
+		munmap(sch->map, sch->mapsz);
+	} else {
+		for (size_t i = 0; i < sch->np; i++) {
+			free(sch->p[i]);
+		}
+		free(sch->deps);
+	}
+	if (sch->vix != NULL) {
+		free(sch->vix->seg);
+		free(sch->vix->off);
+		free(sch->vix);
+	}
+	if (sch->memo != NULL) {
+		for (size_t i = 0; i < countof(sch->memo->e); i++) {
+			for (size_t j = 0; j < countof(*sch->memo->e); j++) {
+				free(sch->memo->e[i][j]);
+			}
+		}
+		free(sch->memo);
 	}
 	free(sch);
 	return;
 }
 
+DEFUN const unsigned int*
+schema_valid_clines(size_t *ncl, trsch_t sch, daysi_t when)
+{
+	const struct trvix_s *vix = sch->vix;
+	size_t i = vix_find_seg(vix->seg, vix->nseg, when);
+
+	if (UNLIKELY(i >= vix->nseg)) {
+		*ncl = 0U;
+		return NULL;
+	}
+	*ncl = vix->off[i + 1U] - vix->off[i];
+	return vix->cl + vix->off[i];
+}
+
 
 /* cuts, this is the glue between schema and cut */
+static const struct trmemo_ent_s*
+sch_memo_get(trsch_t sch, daysi_t when, int y)
+{
+/* return the memo entry for WHEN in year Y, computing it if need be,
+ * this writes to SCH so mustn't race with other users of SCH */
+	const struct trvix_s *vix = sch->vix;
+	size_t seg = vix_find_seg(vix->seg, vix->nseg, when);
+	unsigned int leapp = (y % 4) == 0;
+	unsigned int doy = when - idate_to_daysi(y * 10000U + 101U) + 1U;
+	struct trmemo_ent_s *e;
+	const unsigned int *cl;
+	size_t ncl;
+
+	if (UNLIKELY(sch->memo == NULL)) {
+		sch->memo = calloc(1, sizeof(*sch->memo));
+	}
+	if (LIKELY((e = sch->memo->e[leapp][doy]) != NULL && e->seg == seg)) {
+		/* bingo */
+		return e;
+	}
+
+	/* compute afresh */
+	cl = schema_valid_clines(&ncl, sch, when);
+	e = realloc(e, sizeof(*e) + ncl * sizeof(*e->cl));
+	e->seg = seg;
+	e->ncl = ncl;
+	for (size_t i = 0; i < ncl; i++) {
+		const struct cline_s *p = sch->p[cl[i]];
+		size_t j;
+
+		e->cl[i].inp = 0U;
+		e->cl[i].y = 0.0;
+		for (j = 0; j < p->nn - 1; j++) {
+			const struct cnode_s *n1 = p->n + j;
+			const struct cnode_s *n2 = n1 + 1;
+			daysi_t l1 = daysi_in_year(n1->l, y);
+			daysi_t l2 = daysi_in_year(n2->l, y);
+
+			if (when > l2) {
+				continue;
+			} else if (when >= l1) {
+				/* something happened between n1 and n2 */
+				double xsub = l2 - l1;
+				double tsub = when - l1;
+				double ysub = n2->y - n1->y;
+
+				e->cl[i].inp = 1U;
+				e->cl[i].y = n1->y + tsub * ysub / xsub;
+			}
+			break;
+		}
+		e->cl[i].j = j;
+	}
+	sch->memo->e[leapp][doy] = e;
+	return e;
+}
+
 DEFUN trcut_t
 make_cut(trcut_t old, trsch_t sch, daysi_t when)
 {
 	trcut_t res = old;
 	int y = daysi_to_year(when);
+	const struct trmemo_ent_s *e;
+	const unsigned int *cl;
+	size_t ncl;
 
 	if (old) {
 		/* quickly rinse the old cut */
-		for (size_t i = 0; i < old->ncomps; i++) {
-			old->comps[i].y = 0.0;
-		}
+		cut_rinse(old);
 	}
-	for (size_t i = 0; i < sch->np; i++) {
-		struct cline_s *p = sch->p[i];
+	/* only visit the clines valid on WHEN, and look up their
+	 * exposures relative to the year in the memo */
+	cl = schema_valid_clines(&ncl, sch, when);
+	e = sch_memo_get(sch, when, y);
+	for (size_t i = 0; i < ncl; i++) {
+		struct cline_s *p = sch->p[cl[i]];
+		struct trcc_s cc;
 
-		/* check year validity */
-		if (when < p->valid_from || when > p->valid_till) {
-			/* cline isn't applicable */
+		if (!e->cl[i].inp) {
 			continue;
 		}
-		for (size_t j = 0; j < p->nn - 1; j++) {
-			struct cnode_s *n1 = p->n + j;
-			struct cnode_s *n2 = n1 + 1;
-			daysi_t l1 = daysi_in_year(n1->l, y);
-			daysi_t l2 = daysi_in_year(n2->l, y);
+		cc.month = p->month;
+		cc.year = (uint16_t)(y + p->year_off);
+		cc.y = e->cl[i].y;
 
-			if (when >= l1 && when <= l2) {
-				/* something happened between n1 and n2 */
-				struct trcc_s cc;
-				double xsub = l2 - l1;
-				double tsub = when - l1;
-				double ysub = n2->y - n1->y;
+		/* try and find that guy in the old cut */
+		res = cut_add_cc(res, cc);
+	}
+	return res;
+}
 
-				cc.month = p->month;
-				cc.year = (uint16_t)(y + p->year_off);
-				cc.y = n1->y + tsub * ysub / xsub;
+static size_t
+cuts_find_con(trcuts_t c, char month, uint16_t year)
+{
+/* return the column of contract MONTH/YEAR in C, adding one if need be */
+	size_t res;
 
-				/* try and find that guy in the old cut */
-				res = cut_add_cc(res, cc);
-				break;
+	for (res = 0; res < c->ncons; res++) {
+		if (c->cons[res].month == month && c->cons[res].year == year) {
+			return res;
+		}
+	}
+	/* append a column of zeroes */
+	if ((c->ncons % 16U) == 0U) {
+		size_t nu = c->ncons + 16U;
+
+		c->cons = realloc(c->cons, nu * sizeof(*c->cons));
+		c->y = realloc(c->y, nu * c->ndates * sizeof(*c->y));
+	}
+	memset(c->y + res * c->ndates, 0, c->ndates * sizeof(*c->y));
+	c->cons[c->ncons].month = month;
+	c->cons[c->ncons].year = year;
+	c->cons[c->ncons].y = 0.0;
+	c->ncons++;
+	return res;
+}
+
+static void
+cuts_interp(
+	double *restrict tgt, const daysi_t *restrict when, size_t n,
+	const struct cnode_s *n1, daysi_t l1, daysi_t l2)
+{
+/* interpolate the node pair N1/N1+1 (at L1 and L2) at N dates WHEN,
+ * this is written so that compilers can vectorise it */
+	const struct cnode_s *n2 = n1 + 1;
+	const double xsub = l2 - l1;
+	const double ysub = n2->y - n1->y;
+	const double y1 = n1->y;
+
+	for (size_t k = 0; k < n; k++) {
+		double tsub = (double)(when[k] - l1);
+
+		tgt[k] = y1 + tsub * ysub / xsub;
+	}
+	return;
+}
+
+DEFUN trcuts_t
+make_cuts(trsch_t sch, const daysi_t *when, size_t n)
+{
+	const struct trvix_s *vix = sch->vix;
+	trcuts_t res;
+
+	res = calloc(1, sizeof(*res));
+	res->ndates = n;
+	for (size_t k0 = 0, k1; k0 < n; k0 = k1) {
+		/* find a block of ascending dates within the same year and
+		 * the same validity segment */
+		int y = daysi_to_year(when[k0]);
+		size_t seg = vix_find_seg(vix->seg, vix->nseg, when[k0]);
+		daysi_t end = idate_to_daysi((y + 1) * 10000U + 101U);
+		const unsigned int *cl;
+		size_t ncl;
+
+		if (seg < vix->nseg && vix->seg[seg + 1U] < end) {
+			end = vix->seg[seg + 1U];
+		} else if (seg >= vix->nseg &&
+			   vix->nseg && when[k0] < vix->seg[0U] &&
+			   vix->seg[0U] < end) {
+			/* stop where the first segment starts */
+			end = vix->seg[0U];
+		}
+		for (k1 = k0 + 1U;
+		     k1 < n && when[k1] >= when[k1 - 1U] && when[k1] < end; k1++);
+
+		if (seg >= vix->nseg) {
+			/* no clines valid on the whole block */
+			continue;
+		}
+		cl = schema_valid_clines(&ncl, sch, when[k0]);
+		for (size_t i = 0; i < ncl; i++) {
+			const struct cline_s *p = sch->p[cl[i]];
+			uint16_t cy = (uint16_t)(y + p->year_off);
+			double *col = NULL;
+			size_t k = k0;
+
+			for (size_t j = 0; j < p->nn - 1 && k < k1; j++) {
+				daysi_t l1 = daysi_in_year(p->n[j + 0U].l, y);
+				daysi_t l2 = daysi_in_year(p->n[j + 1U].l, y);
+				size_t kj;
+
+				if (j == 0U) {
+					/* skip dates before the first node */
+					for (; k < k1 && when[k] < l1; k++);
+				}
+				for (kj = k; kj < k1 && when[kj] <= l2; kj++);
+				if (kj == k) {
+					continue;
+				} else if (col == NULL) {
+					size_t c = cuts_find_con(res, p->month, cy);
+					col = res->y + c * res->ndates;
+				}
+				cuts_interp(col + k, when + k, kj - k, p->n + j, l1, l2);
+				k = kj;
 			}
 		}
 	}
 	return res;
 }
 
+DEFUN void
+free_cuts(trcuts_t c)
+{
+	if (c->cons) {
+		free(c->cons);
+	}
+	if (c->y) {
+		free(c->y);
+	}
+	free(c);
+	return;
+}
+
 DEFUN void
 free_cut(trcut_t cut)
 {
@@ -472,4 +1751,214 @@ free_cut(trcut_t cut)
 	return;
 }
 
+
+/* cut cursors, make_cut() for chronologically ascending dates */
+struct trcur_cl_s {
+	const struct cline_s *p;
+	/* index of the node pair bracketing the cursor's date,
+	 * 0 if the cline hasn't started yet, P->NN - 1 if it's over */
+	size_t j;
+	/* node pair J in the cursor's year */
+	daysi_t l1;
+	daysi_t l2;
+	struct trcc_s cc;
+};
+
+struct trcur_s {
+	trsch_t sch;
+	trcut_t cut;
+
+	/* date of the last advance and its year */
+	daysi_t last;
+	int y;
+	/* first date after LAST where the set of clines changes */
+	daysi_t end;
+	/* first date after LAST where any cline moves to another node pair */
+	daysi_t next;
+	/* whether any cline is on a slope */
+	unsigned int slopep:1;
+
+	size_t ncl;
+	struct trcur_cl_s *cl;
+};
+
+static bool
+cur_cl_in_p(const struct trcur_cl_s *c)
+{
+	return c->j < c->p->nn - 1U && c->l1 <= c->l2;
+}
+
+static void
+cur_cl_seek(struct trcur_cl_s *c, daysi_t when, int y)
+{
+/* move C's node pair forward so that it brackets WHEN */
+	const struct cline_s *p = c->p;
+
+	for (; c->j < p->nn - 1U; c->j++) {
+		c->l1 = daysi_in_year(p->n[c->j + 0U].l, y);
+		c->l2 = daysi_in_year(p->n[c->j + 1U].l, y);
+
+		if (when <= c->l2) {
+			break;
+		}
+	}
+	if (UNLIKELY(c->j == 0U && when < c->l1)) {
+		/* not started yet, mark as out of range */
+		c->l2 = c->l1 - 1U;
+	}
+	return;
+}
+
+static void
+cur_cl_interp(struct trcur_cl_s *c, daysi_t when)
+{
+	const struct cnode_s *n1 = c->p->n + c->j;
+	const struct cnode_s *n2 = n1 + 1;
+	double xsub = c->l2 - c->l1;
+	double tsub = when - c->l1;
+	double ysub = n2->y - n1->y;
+
+	c->cc.y = n1->y + tsub * ysub / xsub;
+	return;
+}
+
+static void
+cur_step(trcur_t cur, daysi_t when)
+{
+/* move all clines to their node pairs for WHEN and rebuild the cut */
+	trcut_t res = cur->cut;
+	daysi_t next = cur->end;
+
+	cur->slopep = 0U;
+	if (res) {
+		/* quickly rinse the old cut */
+		cut_rinse(res);
+	}
+	for (size_t i = 0; i < cur->ncl; i++) {
+		struct trcur_cl_s *c = cur->cl + i;
+
+		cur_cl_seek(c, when, cur->y);
+		if (c->j >= c->p->nn - 1U) {
+			/* cline's over for this year */
+			continue;
+		} else if (!cur_cl_in_p(c)) {
+			/* cline starts at l1 */
+			if (c->l1 < next) {
+				next = c->l1;
+			}
+			continue;
+		}
+		/* next move is past l2 */
+		if (c->l2 + 1U < next) {
+			next = c->l2 + 1U;
+		}
+		if (c->p->n[c->j].y != c->p->n[c->j + 1U].y) {
+			cur->slopep = 1U;
+		}
+		cur_cl_interp(c, when);
+		res = cut_add_cc(res, c->cc);
+	}
+	cur->cut = res;
+	cur->next = next;
+	return;
+}
+
+static void
+cur_reset(trcur_t cur, daysi_t when)
+{
+/* rebuild the cursor's set of clines from scratch */
+	const struct trvix_s *vix = cur->sch->vix;
+	const unsigned int *cl;
+	size_t ncl;
+	int y = daysi_to_year(when);
+	size_t seg = vix_find_seg(vix->seg, vix->nseg, when);
+
+	const struct trmemo_ent_s *e;
+
+	cl = schema_valid_clines(&ncl, cur->sch, when);
+	e = sch_memo_get(cur->sch, when, y);
+	cur->y = y;
+	cur->ncl = ncl;
+	cur->cl = realloc(cur->cl, (ncl + 1U) * sizeof(*cur->cl));
+	for (size_t i = 0; i < ncl; i++) {
+		const struct cline_s *p = cur->sch->p[cl[i]];
+
+		cur->cl[i].p = p;
+		/* start off with the node pair from the memo */
+		cur->cl[i].j = e->cl[i].j;
+		cur->cl[i].cc.month = p->month;
+		cur->cl[i].cc.year = (uint16_t)(y + p->year_off);
+	}
+
+	/* the cursor's set of clines is good till the end of the segment
+	 * or the end of the year, whichever comes first */
+	cur->end = idate_to_daysi((y + 1) * 10000U + 101U);
+	if (seg < vix->nseg && vix->seg[seg + 1U] < cur->end) {
+		/* segment ends before the year does */
+		cur->end = vix->seg[seg + 1U];
+	} else if (seg >= vix->nseg && when < vix->seg[0U] &&
+		   vix->seg[0U] < cur->end) {
+		/* first segment starts before the year ends */
+		cur->end = vix->seg[0U];
+	}
+	return;
+}
+
+DEFUN trcur_t
+make_cut_cursor(trsch_t sch)
+{
+	trcur_t res = calloc(1, sizeof(*res));
+
+	res->sch = sch;
+	return res;
+}
+
+DEFUN void
+free_cut_cursor(trcur_t cur)
+{
+	if (cur->cut) {
+		free_cut(cur->cut);
+	}
+	if (cur->cl) {
+		free(cur->cl);
+	}
+	free(cur);
+	return;
+}
+
+DEFUN trcut_t
+cut_cursor_advance(trcur_t cur, daysi_t when)
+{
+	if (UNLIKELY(when < cur->last || !cur->last)) {
+		/* no way but to start afresh */
+		cur_reset(cur, when);
+		cur_step(cur, when);
+	} else if (when >= cur->next) {
+		if (when >= cur->end) {
+			/* year or validity segment changed */
+			cur_reset(cur, when);
+		}
+		cur_step(cur, when);
+	} else {
+		/* no cline moves to another node pair, only update the
+		 * ones on a slope and revive the ones that have been
+		 * removed from the cut in the meantime */
+		trcut_t res = cur->cut;
+
+		for (size_t i = 0; i < cur->ncl; i++) {
+			struct trcur_cl_s *c = cur->cl + i;
+
+			if (!cur_cl_in_p(c)) {
+				continue;
+			} else if (cur->slopep) {
+				cur_cl_interp(c, when);
+			}
+			res = cut_add_cc(res, c->cc);
+		}
+		cur->cut = res;
+	}
+	cur->last = when;
+	return cur->cut;
+}
+
 /* schema.c ends here */
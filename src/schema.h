@@ -38,19 +38,55 @@
 #define INCLUDED_schema_h_
 
 #include <stdio.h>
+#include "dt-strpf.h"
 
 #if !defined DECLF
 # define DECLF		extern
 # define DEFUN
 #endif	/* !DECLF */
 
+/* Schemas memoise the cuts make_cut() and cut cursors compute, by day of
+ * the year, so these mutate the schema they're given even when its
+ * clines live in a read-only compiled file.  Don't use the same schema in
+ * several threads at once, give each thread a schema of its own. */
 typedef struct trsch_s *trsch_t;
+typedef struct trsch_lib_s *trsch_lib_t;
 
 
 /**
- * Read truffle roll-over schema from FILE. */
+ * Read truffle roll-over schema from FILE.
+ * FILE may be a compiled schema, and if there's a compiled schema named
+ * FILE.trsc at least as fresh as FILE and the calendar files below,
+ * that one is used instead.
+ * Nodes may be given relative to last trade dates, as in LTD-5b (5
+ * business days before the contract's last trade date) or LTD[Z-1]+2
+ * (2 days after that of the previous year's Z contract), in which case
+ * directives `@expiries FILE' and `@holidays FILE' provide the dates. */
 DECLF trsch_t read_schema(const char *file);
 
+/**
+ * Write SCH in compiled form to FILE, see read_schema().
+ * Return 0 on success, -1 otherwise. */
+DECLF int compile_schema(trsch_t sch, const char *file);
+
+/**
+ * Open the schema library FILE, i.e. a file of schemas each of which is
+ * preceded by a line [ROOT].  Only the section headers are indexed. */
+DECLF trsch_lib_t open_schema_lib(const char *file);
+
+/**
+ * Free resources associated with a schema library. */
+DECLF void close_schema_lib(trsch_lib_t);
+
+/**
+ * Read the schema of ROOT from library LIB, or NULL if there's none. */
+DECLF trsch_t read_schema_lib(trsch_lib_t lib, const char *root);
+
+/**
+ * Return a copy of SCH with its roll dates shifted by DAYS days.
+ * Nodes on 01-01 and 12-31 stay where they are. */
+DECLF trsch_t shift_schema(trsch_t sch, int days);
+
 /**
  * Free resources associated with roll-over schema. */
 DECLF void free_schema(trsch_t);
@@ -59,4 +95,10 @@ DECLF void free_schema(trsch_t);
  * Print schema SCH to stream WHITHER. */
 DECLF void print_schema(trsch_t sch, FILE *whither);
 
+/**
+ * Return the indices of the clines in SCH that are valid on WHEN,
+ * the number of indices is stored in NCL. */
+DECLF const unsigned int*
+schema_valid_clines(size_t *ncl, trsch_t sch, daysi_t when);
+
 #endif	/* INCLUDED_schema_h_ */
@@ -55,6 +55,7 @@
 
 struct __dv_s {
 	idate_t d;
+	uint64_t k;
 	double v;
 };
 
@@ -175,21 +176,22 @@ upsize_mall(void *ptr, size_t cnt, size_t cnn, size_t blksz, size_t inc, int f)
 
 /* helpers */
 static struct __dvv_s*
-tsc_init_dvv(trtsc_t s, size_t idx, idate_t dt)
+tsc_init_dvv(trtsc_t s, size_t idx, struct __dv_s dv)
 {
 	struct __dvv_s *t = s->dvvs + idx;
 
-	t->d = dt;
+	t->d = dv.d;
+	t->k = dv.k;
 	/* make room for s->ncons doubles and set them to nan */
 	t->v = upsize_mall(t->v, 0, s->ncons, sizeof(*t->v), CYM_STEP, -1);
 	return t;
 }
 
 static struct __dvv_s*
-tsc_find_dvv(trtsc_t s, idate_t dt)
+tsc_find_dvv(trtsc_t s, uint64_t k)
 {
 	for (size_t i = 0; i < s->ndvvs; i++) {
-		if (s->dvvs[i].d == dt) {
+		if (s->dvvs[i].k == k) {
 			return s->dvvs + i;
 		}
 	}
@@ -197,11 +199,11 @@ tsc_find_dvv(trtsc_t s, idate_t dt)
 }
 
 static ssize_t
-tsc_find_dvv_idx(trtsc_t s, idate_t dt)
+tsc_find_dvv_idx(trtsc_t s, uint64_t k)
 {
-/* find first index where dvv date >= dt */
+/* find first index where dvv stamp >= k */
 	for (size_t i = 0; i < s->ndvvs; i++) {
-		if (s->dvvs[i].d >= dt) {
+		if (s->dvvs[i].k >= k) {
 			return i;
 		}
 	}
@@ -230,25 +232,25 @@ tsc_add_dv(trtsc_t s, trym_t ym, struct __dv_s dv)
 	struct __dvv_s *this = NULL;
 	ssize_t idx = 0;
 
-	/* find the date in question first */
-	if (dv.d > s->last) {
+	/* find the stamp in question first */
+	if (s->ndvvs == 0U || dv.k > s->dvvs[s->ndvvs - 1U].k) {
 		/* append */
 		s->dvvs = resize_mmap(
 			s->dvvs, s->ndvvs, sizeof(*s->dvvs), TSC_STEP);
-		this = tsc_init_dvv(s, s->ndvvs++, dv.d);
+		this = tsc_init_dvv(s, s->ndvvs++, dv);
 		/* update stats */
 		s->last = dv.d;
 		if (UNLIKELY(s->first == 0)) {
 			s->first = dv.d;
 		}
-	} else if ((this = tsc_find_dvv(s, dv.d)) != NULL) {
+	} else if ((this = tsc_find_dvv(s, dv.k)) != NULL) {
 		/* bingo */
 		;
-	} else if (dv.d < s->first ||
-		   (idx = tsc_find_dvv_idx(s, dv.d)) > 0) {
+	} else if (dv.k < s->dvvs[0U].k ||
+		   (idx = tsc_find_dvv_idx(s, dv.k)) > 0) {
 		/* prepend, FUCK */
 		tsc_move(s, idx, 1);
-		this = tsc_init_dvv(s, idx, dv.d);
+		this = tsc_init_dvv(s, idx, dv);
 		if (UNLIKELY(dv.d < s->first)) {
 			s->first = dv.d;
 		}
@@ -304,9 +306,27 @@ read_series(FILE *f)
 		if ((dat = strchr(con, '\t')) == NULL) {
 			break;
 		}
-		if (!(dv.d = read_date(dat + 1, &val)) ||
-		    (val == NULL) ||
-		    (dv.v = strtod(val + 1, &val), val) == NULL) {
+		if (!(dv.d = read_date(dat + 1, &val)) || (val == NULL)) {
+			break;
+		} else if (*val == 'T') {
+			/* intraday stamp, reparse it as instant */
+			trod_instant_t t = dt_strp(dat + 1);
+
+			if (trod_inst_0_p(t) ||
+			    (val = strchr(val, '\t')) == NULL) {
+				break;
+			}
+			dv.k = trod_inst_key(t);
+			res->intradayp = 1U;
+		} else {
+			dv.k = trod_inst_key((trod_instant_t){
+					.y = idate_y(dv.d),
+					.m = idate_m(dv.d),
+					.d = idate_d(dv.d),
+					.H = TROD_ALL_DAY,
+				});
+		}
+		if ((dv.v = strtod(val + 1, &val), val) == NULL) {
 			break;
 		}
 
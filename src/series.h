@@ -52,12 +52,13 @@
 typedef struct trtsc_s *trtsc_t;
 typedef const struct trtsc_s *const_trtsc_t;
 
-/* once-a-day series */
+/* once-a-day series, or intraday if any of its stamps has a time */
 struct trtsc_s {
 	size_t ndvvs;
 	size_t ncons;
 	idate_t first;
 	idate_t last;
+	unsigned int intradayp:1;
 	trym_t *cons;
 	struct __dvv_s *dvvs;
 };
@@ -65,6 +66,9 @@ struct trtsc_s {
 struct __dvv_s {
 	idate_t d;
 	daysi_t dd;
+	/* the stamp's instant as per trod_inst_key(),
+	 * once-a-day stamps are TROD_ALL_DAY instants */
+	uint64_t k;
 	double *v;
 };
 
@@ -45,7 +45,12 @@
 #include <string.h>
 #include <ctype.h>
 #include <math.h>
+#include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#if defined STANDALONE
+# include <pthread.h>
+#endif	/* STANDALONE */
 #if defined WORDS_BIGENDIAN
 # include <limits.h>
 #endif	/* WORDS_BIGENDIAN */
@@ -55,6 +60,9 @@
 #include "trod.h"
 #include "gq.h"
 #include "mmy.h"
+#if !defined STANDALONE
+# include "gbs.h"
+#endif	/* !STANDALONE */
 
 #if defined STANDALONE
 # include "daisy.c"
@@ -110,6 +118,14 @@
 #define __static_assert2(X, L)	__static_assert3(X, L)
 #define static_assert(X)	__static_assert2(X, __LINE__)
 
+/* binary trods start with this */
+#define TROD_BIN_MAGIC	"TROD"
+#define TROD_BIN_VER	(2U)
+#define TROD_BIN_ENDIAN	(0x01020304U)
+/* and trod tables with this */
+#define TROD_TBL_MAGIC	"TRTB"
+#define TROD_TBL_VER	(1U)
+
 typedef struct trod_state_s *trod_state_t;
 typedef struct trod_event_s *trod_event_t;
 
@@ -137,10 +153,29 @@ struct trod_event_s {
 	struct trod_state_s what[];
 };
 
+/* snapshot of the active contracts at a year flip */
+struct trod_snap_s {
+	/* index of the first instant in the new year */
+	size_t i;
+	/* number of state changes before instant I */
+	int nchg;
+	/* year the active bits are relative to */
+	unsigned int y;
+	/* active bits are the trod's SBIT[OFF .. OFF + NBIT) */
+	size_t off;
+	size_t nbit;
+};
+
 /* trod container */
 struct trod_s {
 	size_t ninst;
 	size_t nev;
+	/* snapshots, one per year, to seek from */
+	size_t nsnap;
+	struct trod_snap_s *snap;
+	unsigned int *sbit;
+	/* instants' keys as per trod_inst_ev_key(), for cursors */
+	uint64_t *key;
 	/* 0_event terminated list of events (NINST of them) */
 	trod_event_t ev[];
 };
@@ -161,6 +196,7 @@ struct troq_s {
 };
 
 
+#if defined STANDALONE
 static void*
 make_gq_item(gq_t x, size_t nmemb, size_t membz)
 {
@@ -218,52 +254,55 @@ troq_add_event(struct troq_s tgt[static 1], trod_event_t ev)
 	return;
 }
 
+/* single-state event, as handed out by troq_pop_event() */
+struct troq_ev1_s {
+	struct trod_event_s ev;
+	struct trod_state_s st;
+};
+
 static trod_event_t
-troq_pop_event(struct troq_s src[static 1])
+troq_pop_event(struct troq_ev1_s *restrict res, struct troq_s src[static 1])
 {
+/* pop the next event off SRC into RES */
 	struct troqi_s *qi;
-	static struct {
-		struct trod_event_s ev;
-		struct trod_state_s st;
-	} res;
 
 	if (UNLIKELY((qi = (void*)gq_pop_head(src->trev)) == NULL)) {
 		return NIL_EVENT;
 	}
 
-	res.ev = qi->ev;
-	res.st = qi->what;
+	res->ev = qi->ev;
+	res->st = qi->what;
 	free_gq_item(pool, (gq_item_t)qi);
-	return &res.ev;
+	return &res->ev;
 }
+#endif	/* STANDALONE */
 
 #if !defined STANDALONE
-static trod_event_t
-read_trod_event(const char *line, size_t UNUSED(llen))
+static int
+read_trod_line(
+	trod_instant_t *restrict when, struct trod_state_s *restrict st,
+	const char *line, size_t llen)
 {
-/* just a normal echse edge line */
-	static struct {
-		struct trod_event_s ev;
-		struct trod_state_s st;
-	} res;
+/* just a normal echse edge line, put the instant into WHEN and the
+ * state into ST, return -1 if the line isn't one */
 	const char *p;
 	const char *q;
 	trym_t ym;
 
-	if ((p = strchr(line, '\t')) == NULL) {
-		goto nul;
-	} else if (trod_inst_0_p(res.ev.when = dt_strp(line))) {
-		goto nul;
+	if ((p = memchr(line, '\t', llen)) == NULL) {
+		return -1;
+	} else if (trod_inst_0_p(*when = dt_strp(line))) {
+		return -1;
 	}
 
 	/* otherwise it's a match, snarf the val month year bit */
 	switch (*++p) {
 	case '~':
-		res.st.val = 0U;
+		st->val = 0U;
 		p++;
 		break;
 	default:
-		res.st.val = 1U;
+		st->val = 1U;
 		break;
 	}
 
@@ -271,46 +310,20 @@ snarf:
 	/* now it's either YYYY-MM, or M-YYYY or M-dy where DY is relative
 	 * to the year portion of I */
 	if (UNLIKELY(!(ym = read_trym(p, &q)) || q <= p)) {
-		goto nul;
+		return -1;
 	} else if (ym < TRYM_ABS_CUTOFF) {
 		/* always use absolute tryms */
-		ym = abs_trym(ym, res.ev.when.y);
+		ym = abs_trym(ym, when->y);
 	}
-	res.st.ym = ym;
+	st->ym = ym;
 	/* check if it's a A->B state */
 	if (*q++ == '-' && *q++ == '>') {
 		/* ah good, but we need to capture the bit right of the arrow */
-		res.st.val = 2U;
+		st->val = 2U;
 		p = q;
 		goto snarf;
 	}
-	return &res.ev;
-nul:
-	return NIL_EVENT;
-}
-
-static struct troq_s
-read_troq(FILE *f)
-{
-	struct troq_s q = {0UL, 0UL};
-	trod_instant_t last = {0};
-	size_t llen = 0UL;
-	char *line = NULL;
-	ssize_t nrd;
-
-	while ((nrd = getline(&line, &llen, f)) > 0) {
-		trod_event_t ev = read_trod_event(line, nrd);
-
-		if (trod_inst_le_p(last, ev->when)) {
-			troq_add_event(&q, ev);
-			last = ev->when;
-		}
-	}
-
-	if (line) {
-		free(line);
-	}
-	return q;
+	return 0;
 }
 #endif	/* !STANDALONE */
 
@@ -326,11 +339,13 @@ chunk_inc_what(trod_event_t cp)
 	return (void*)((char*)cp + sizeof(*cp->what));
 }
 
+#if defined STANDALONE
 static trod_t
 troq_to_trod(struct troq_s q)
 {
 /* go over the queue Q and arrange stuff in arrays and array-of-arrays */
 	trod_instant_t last = {0};
+	struct troq_ev1_s ev1;
 	trod_event_t chunk;
 	trod_event_t cp;
 	size_t chunz;
@@ -341,6 +356,10 @@ troq_to_trod(struct troq_s q)
 	res = malloc(sizeof(*res) + q.ninst * sizeof(*res->ev));
 	res->ninst = 0UL;
 	res->nev = 0UL;
+	res->nsnap = 0UL;
+	res->snap = NULL;
+	res->sbit = NULL;
+	res->key = NULL;
 
 	/* we also know about the total number of events */
 	chunz = q.ninst * sizeof(*chunk) +
@@ -352,7 +371,7 @@ troq_to_trod(struct troq_s q)
 	cp = (void*)((char*)chunk - sizeof(*chunk->what));
 
 	for (trod_event_t ev, c;
-	     (ev = troq_pop_event(&q), !trod_inst_0_p(ev->when));) {
+	     (ev = troq_pop_event(&ev1, &q), !trod_inst_0_p(ev->when));) {
 		if (trod_inst_lt_p(last, ev->when)) {
 			/* start a new chamber */
 			size_t iidx = res->ninst++;
@@ -378,6 +397,7 @@ troq_to_trod(struct troq_s q)
 	assert(chunz == (char*)cp - (char*)chunk);
 	return res;
 }
+#endif	/* STANDALONE */
 
 
 /* public API */
@@ -385,31 +405,759 @@ troq_to_trod(struct troq_s q)
 DEFUN void
 free_trod(trod_t td)
 {
+	if (td->snap != NULL) {
+		free(td->snap);
+	}
+	if (td->sbit != NULL) {
+		free(td->sbit);
+	}
+	if (td->key != NULL) {
+		free(td->key);
+	}
 	free(td);
 	return;
 }
 
+/* events as read, sorted by their packed instants */
+struct trev_s {
+	uint64_t key;
+	struct trod_state_s st;
+};
+
+static void
+trev_sort(struct trev_s *restrict ev, size_t nev)
+{
+/* stable LSD radix sort on the keys, a byte at a time, skipping bytes
+ * that are the same in all keys, like the time bits in daily trods */
+	struct trev_s *tmp = malloc(nev * sizeof(*tmp));
+	struct trev_s *src = ev;
+	struct trev_s *tgt = tmp;
+
+	for (unsigned int sh = 0U; sh < 64U; sh += 8U) {
+		size_t cnt[256U] = {0U};
+		size_t sum = 0U;
+
+		for (size_t i = 0; i < nev; i++) {
+			cnt[(src[i].key >> sh) & 0xffU]++;
+		}
+		if (cnt[(src[0U].key >> sh) & 0xffU] == nev) {
+			/* nothing to do for this byte */
+			continue;
+		}
+		for (size_t b = 0; b < countof(cnt); b++) {
+			size_t c = cnt[b];
+
+			cnt[b] = sum;
+			sum += c;
+		}
+		for (size_t i = 0; i < nev; i++) {
+			tgt[cnt[(src[i].key >> sh) & 0xffU]++] = src[i];
+		}
+		/* swap roles */
+		tgt = src;
+		src = src == ev ? tmp : ev;
+	}
+	if (src != ev) {
+		memcpy(ev, src, nev * sizeof(*ev));
+	}
+	free(tmp);
+	return;
+}
+
+static void trod_mksnap(trod_t td);
+
+static trod_t
+read_trod_buf(const char *buf, size_t bsz)
+{
+/* parse the lines in BUF, sort them chronologically (lines of the same
+ * instant stay in order) and lay them out like troq_to_trod() does,
+ * there's at most one instant and one state per line so the number of
+ * lines tells us how much to allocate */
+	const char *const eob = buf + bsz;
+	struct trev_s *ev;
+	size_t nev = 0U;
+	bool sortedp = true;
+	uint64_t last = 0U;
+	trod_event_t chunk;
+	trod_event_t cp;
+	trod_event_t c = NULL;
+	size_t nln = 1U;
+	size_t chunz;
+	size_t widx = 0UL;
+	trod_t res;
+
+	for (const char *bp = buf;
+	     bp < eob && (bp = memchr(bp, '\n', eob - bp)) != NULL;
+	     bp++, nln++);
+
+	ev = malloc(nln * sizeof(*ev));
+	for (const char *bp = buf, *ep; bp < eob; bp = ep + 1U) {
+		trod_instant_t when;
+		size_t llen;
+
+		if ((ep = memchr(bp, '\n', eob - bp)) == NULL) {
+			ep = eob;
+		}
+		llen = ep - bp;
+		if (UNLIKELY(ep >= eob)) {
+			/* last line without newline, don't parse past BUF */
+			char tmp[llen + 1U];
+
+			memcpy(tmp, bp, llen);
+			tmp[llen] = '\0';
+			if (read_trod_line(&when, &ev[nev].st, tmp, llen) < 0) {
+				continue;
+			}
+		} else if (read_trod_line(&when, &ev[nev].st, bp, llen) < 0) {
+			continue;
+		}
+		ev[nev].key = trod_inst_key(when);
+		sortedp &= ev[nev].key >= last;
+		last = ev[nev].key;
+		nev++;
+	}
+	if (!sortedp) {
+		trev_sort(ev, nev);
+	}
+
+	/* the chunk goes right after the instants, so free_trod() gets
+	 * rid of everything */
+	chunz = nln * sizeof(*chunk) + 2U * nln * sizeof(*chunk->what);
+	res = calloc(sizeof(*res) + nln * sizeof(*res->ev) + chunz, 1);
+	chunk = (void*)(res->ev + nln);
+	cp = (void*)((char*)chunk - sizeof(*chunk->what));
+
+	last = 0U;
+	for (size_t i = 0; i < nev; i++) {
+		if (last < ev[i].key) {
+			/* start a new chamber */
+			cp = chunk_inc_what(cp);
+			res->ev[res->ninst++] = c = cp;
+			c->when = trod_key_inst(last = ev[i].key);
+			cp = chunk_inc_when(cp);
+			widx = 0UL;
+		}
+		/* aggregate */
+		c->what[widx++] = ev[i].st;
+		cp = chunk_inc_what(cp);
+		res->nev++;
+	}
+	free(ev);
+	/* prepare for random access */
+	trod_mksnap(res);
+	return res;
+}
+
+/* binary trods */
+struct trod_bin_s {
+	char magic[4U];
+	uint32_t ver;
+	uint32_t endian;
+	/* always 0 */
+	uint32_t pad;
+	uint64_t ninst;
+	uint64_t nev;
+	/* followed by NINST strictly ascending instant keys as per
+	 * trod_inst_key(), then NINST + 1 offsets with
+	 * the states of the K-th instant at OFF[K] .. OFF[K + 1] - 1,
+	 * then NEV states as struct trod_stat3_s */
+};
+
+static trod_t
+read_trod_bin(const char *buf, size_t bsz)
+{
+/* lay out the binary trod in BUF like read_trod_buf() does */
+	const struct trod_bin_s *hdr = (const void*)buf;
+	const uint64_t *inst;
+	const uint64_t *off;
+	const struct trod_stat3_s *st;
+	char *cp;
+	trod_t res;
+
+	if (hdr->ver != TROD_BIN_VER || hdr->endian != TROD_BIN_ENDIAN) {
+		/* from another version or a host of different byte order */
+		return NULL;
+	} else if (hdr->ninst > bsz / sizeof(*inst) ||
+		   hdr->nev > bsz / sizeof(*st) ||
+		   bsz < sizeof(*hdr) +
+		   (2U * hdr->ninst + 1U) * sizeof(*inst) +
+		   hdr->nev * sizeof(*st)) {
+		/* truncated */
+		return NULL;
+	}
+	inst = (const void*)(hdr + 1U);
+	off = inst + hdr->ninst;
+	st = (const void*)(off + hdr->ninst + 1U);
+	if (off[0U] != 0U || off[hdr->ninst] != hdr->nev) {
+		return NULL;
+	}
+	for (size_t k = 1U; k < hdr->ninst; k++) {
+		if (UNLIKELY(inst[k] <= inst[k - 1U])) {
+			/* cursors and merges rely on the order */
+			return NULL;
+		}
+	}
+
+	res = calloc(
+		sizeof(*res) + hdr->ninst * sizeof(*res->ev) +
+		hdr->ninst * sizeof(**res->ev) +
+		(hdr->nev + hdr->ninst) * sizeof(*res->ev[0U]->what), 1);
+	if (UNLIKELY(res == NULL)) {
+		return NULL;
+	}
+	cp = (void*)(res->ev + hdr->ninst);
+	for (size_t k = 0; k < hdr->ninst; k++) {
+		trod_event_t c = (void*)cp;
+		size_t w = 0U;
+
+		if (UNLIKELY(off[k + 1U] < off[k])) {
+			free(res);
+			return NULL;
+		}
+		c->when = trod_key_inst(inst[k]);
+		for (uint64_t j = off[k]; j < off[k + 1U]; j++, w++) {
+			c->what[w].val = st[j].val;
+			c->what[w].ym = cym_to_trym(st[j].year, st[j].month);
+		}
+		/* the 0-state is already there courtesy of calloc() */
+		cp += sizeof(*c) + (w + 1U) * sizeof(*c->what);
+		res->ev[res->ninst++] = c;
+		res->nev += w;
+	}
+	/* prepare for random access */
+	trod_mksnap(res);
+	return res;
+}
+
+static trod_t
+read_trod_mem(const char *buf, size_t bsz)
+{
+	if (bsz >= sizeof(struct trod_bin_s) &&
+	    !memcmp(buf, TROD_BIN_MAGIC, sizeof(TROD_BIN_MAGIC) - 1U)) {
+		return read_trod_bin(buf, bsz);
+	}
+	return read_trod_buf(buf, bsz);
+}
+
+DEFUN int
+write_trod_bin(trod_t td, FILE *whither)
+{
+	struct trod_bin_s hdr = {
+		.magic = TROD_BIN_MAGIC,
+		.ver = TROD_BIN_VER,
+		.endian = TROD_BIN_ENDIAN,
+		.ninst = td->ninst,
+		.nev = td->nev,
+	};
+	uint64_t off = 0U;
+
+	fwrite(&hdr, sizeof(hdr), 1U, whither);
+	for (size_t k = 0; k < td->ninst; k++) {
+		uint64_t u = trod_inst_key(td->ev[k]->when);
+
+		fwrite(&u, sizeof(u), 1U, whither);
+	}
+	for (size_t k = 0; k < td->ninst; k++) {
+		fwrite(&off, sizeof(off), 1U, whither);
+		for (const struct trod_state_s *s = td->ev[k]->what;
+		     s->ym; s++, off++);
+	}
+	fwrite(&off, sizeof(off), 1U, whither);
+	for (size_t k = 0; k < td->ninst; k++) {
+		for (const struct trod_state_s *s = td->ev[k]->what;
+		     s->ym; s++) {
+			struct trod_stat3_s s3 = {
+				.val = s->val,
+				.month = (uint8_t)trym_mo(s->ym),
+				.year = (uint16_t)trym_yr(s->ym),
+			};
+
+			fwrite(&s3, sizeof(s3), 1U, whither);
+		}
+	}
+	if (fflush(whither) < 0 || ferror(whither)) {
+		return -1;
+	}
+	return 0;
+}
+
 DEFUN trod_t
 read_trod(const char *file)
 {
 /* lines look like
- * DATETIME \t [~] MONTH YEAR ... */
-	struct troq_s q;
-	FILE *f;
+ * DATETIME \t [~] MONTH YEAR ...
+ * unless it's a binary trod */
+	struct stat st;
 	trod_t res;
+	void *buf;
+	int fd;
 
 	if (file[0] == '-' && file[1] == '\0') {
-		f = stdin;
-	} else if ((f = fopen(file, "r")) == NULL) {
+		/* can't map that one, slurp it */
+		size_t bsz = 0U;
+		size_t zbuf = 0U;
+		size_t nrd;
+
+		/* go through stdio, others may have peeked at stdin */
+		buf = NULL;
+		do {
+			if (bsz >= zbuf) {
+				zbuf = (zbuf * 2U) ?: 65536U;
+				buf = realloc(buf, zbuf);
+			}
+			nrd = fread((char*)buf + bsz, 1U, zbuf - bsz, stdin);
+		} while (nrd > 0U && (bsz += nrd));
+		res = read_trod_mem(buf, bsz);
+		free(buf);
+		return res;
+	} else if ((fd = open(file, O_RDONLY)) < 0) {
 		fprintf(stderr, "unable to open file %s\n", file);
 		return NULL;
+	} else if (fstat(fd, &st) < 0) {
+		close(fd);
+		return NULL;
+	} else if (st.st_size <= 0) {
+		close(fd);
+		return read_trod_buf(NULL, 0U);
+	}
+	buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (buf == MAP_FAILED) {
+		return NULL;
 	}
 
-	/* temporary troq queue */
-	q = read_troq(f);
-	fclose(f);
+	res = read_trod_mem(buf, st.st_size);
+	munmap(buf, st.st_size);
+	return res;
+}
 
-	res = troq_to_trod(q);
+
+/* trod cursors */
+struct trod_cursor_s {
+	trod_t td;
+	/* index of the next instant to apply */
+	size_t i;
+	/* key of the instant the cursor is at, see trod_inst_key() */
+	uint64_t last;
+	/* contracts active at LAST, bit 12 * RY + M - 1 for month M of
+	 * the year RY years after LAST's */
+	struct gbs_s active[1U];
+};
+
+static int
+cur_apply_ev(trod_cursor_t cur, trod_event_t ev)
+{
+	gbs_t bs = cur->active;
+	int res = 0;
+
+	for (const struct trod_state_s *s = ev->what; s->ym; s++) {
+		unsigned int m = trym_mo(s->ym);
+		unsigned int y = trym_yr(s->ym);
+		unsigned int bit = 12 * (y - ev->when.y) + (m - 1);
+
+		if (!s->val) {
+			gbs_unset(bs, bit);
+			res++;
+		} else if (s->val > 1U && gbs_set_p(bs, bit)) {
+			continue;
+		} else {
+			gbs_set(bs, bit);
+			res++;
+		}
+	}
+	return res;
+}
+
+DEFUN trod_cursor_t
+make_trod_cursor(trod_t td)
+{
+	trod_cursor_t res = calloc(1, sizeof(*res));
+
+	res->td = td;
+	init_gbs(res->active, 12U * 5U);
+	return res;
+}
+
+DEFUN void
+free_trod_cursor(trod_cursor_t cur)
+{
+	fini_gbs(cur->active);
+	free(cur);
+	return;
+}
+
+static inline unsigned int
+key_y(uint64_t k)
+{
+	return (unsigned int)(k >> 48U);
+}
+
+static int
+cur_fwd(trod_cursor_t cur, uint64_t key)
+{
+/* apply all events keyed up to and including KEY */
+	const trod_t td = cur->td;
+	unsigned int y = key_y(cur->last);
+	int res = 0;
+
+	for (; cur->i < td->ninst && td->key[cur->i] <= key; cur->i++) {
+		trod_event_t x = td->ev[cur->i];
+
+		if (y < x->when.y) {
+			/* flip over to a new year */
+			gbs_shift_lsb(cur->active, 12 * (x->when.y - y));
+			y = x->when.y;
+		}
+		res += cur_apply_ev(cur, x);
+	}
+	if (y < key_y(key)) {
+		/* flip over to KEY's year */
+		gbs_shift_lsb(cur->active, 12 * (key_y(key) - y));
+	}
+	cur->last = key;
+	return res;
+}
+
+static void
+trod_mksnap(trod_t td)
+{
+/* run through TD, key its instants and take a snapshot whenever
+ * the year flips over */
+	struct trod_cursor_s cur = {.td = td};
+	unsigned int y = 0U;
+	size_t zsnap = 0U;
+	size_t zbit = 0U;
+	size_t nbit = 0U;
+	int nchg = 0;
+
+	td->key = malloc((td->ninst ?: 1U) * sizeof(*td->key));
+	init_gbs(cur.active, 12U * 5U);
+	for (; cur.i < td->ninst; cur.i++) {
+		trod_event_t x = td->ev[cur.i];
+
+		td->key[cur.i] = trod_inst_ev_key(x->when);
+		if (y < x->when.y) {
+			struct trod_snap_s *sn;
+			size_t np;
+
+			gbs_shift_lsb(cur.active, 12 * (x->when.y - y));
+			if (td->nsnap >= zsnap) {
+				zsnap = (zsnap * 2U) ?: 64U;
+				td->snap = realloc(
+					td->snap, zsnap * sizeof(*td->snap));
+			}
+			sn = td->snap + td->nsnap++;
+			sn->i = cur.i;
+			sn->nchg = nchg;
+			sn->y = x->when.y;
+			sn->off = nbit;
+			if (nbit + (np = gbs_popcnt(cur.active)) > zbit) {
+				zbit = 2U * zbit + np + 256U;
+				td->sbit = realloc(
+					td->sbit, zbit * sizeof(*td->sbit));
+			}
+			for (int k = 0;
+			     (k = gbs_next_set(cur.active, k)) >= 0; k++) {
+				td->sbit[nbit++] = k;
+			}
+			sn->nbit = nbit - sn->off;
+		}
+		nchg += cur_apply_ev(&cur, x);
+		y = x->when.y;
+	}
+	fini_gbs(cur.active);
+	return;
+}
+
+static int
+cur_seek(trod_cursor_t cur, uint64_t key)
+{
+	const trod_t td = cur->td;
+	const unsigned int y = key_y(key);
+	const struct trod_snap_s *sn;
+	size_t lo = 0U;
+	size_t hi = td->nsnap;
+
+	/* find the last snapshot in or before KEY's year, all instants
+	 * before it are in earlier years */
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2U;
+
+		if (y < td->snap[mid].y) {
+			hi = mid;
+		} else {
+			lo = mid + 1U;
+		}
+	}
+
+	/* rinse and rebuild */
+	gbs_clear(cur->active);
+	if (UNLIKELY(lo == 0U)) {
+		/* build it all up again */
+		cur->last = 0U;
+		cur->i = 0U;
+		return cur_fwd(cur, key);
+	}
+	sn = td->snap + lo - 1U;
+	for (size_t k = 0; k < sn->nbit; k++) {
+		gbs_set(cur->active, td->sbit[sn->off + k]);
+	}
+	/* pretend we're in the snapshot's year already */
+	cur->last = (uint64_t)sn->y << 48U;
+	cur->i = sn->i;
+	return sn->nchg + cur_fwd(cur, key);
+}
+
+DEFUN int
+trod_cursor_seek(trod_cursor_t cur, trod_instant_t inst)
+{
+	return cur_seek(cur, trod_inst_key(inst));
+}
+
+DEFUN int
+trod_cursor_advance_key(trod_cursor_t cur, uint64_t key)
+{
+	if (UNLIKELY(key < cur->last)) {
+		return cur_seek(cur, key);
+	}
+	return cur_fwd(cur, key);
+}
+
+DEFUN int
+trod_cursor_advance(trod_cursor_t cur, trod_instant_t inst)
+{
+	return trod_cursor_advance_key(cur, trod_inst_key(inst));
+}
+
+DEFUN gbs_t
+trod_cursor_active(trod_cursor_t cur)
+{
+	return cur->active;
+}
+
+
+/* dense per-day tables,
+ * the table is a single block without pointers, a header followed by
+ * one entry per day, which is exactly what goes to disk */
+struct trod_tbl_s {
+	char magic[4U];
+	uint32_t ver;
+	uint32_t endian;
+	/* days covered, inclusive */
+	daysi_t from;
+	daysi_t till;
+	/* always 0 */
+	uint32_t pad;
+	/* day FROM + k is in DAY[k] */
+	struct trod_day_s day[];
+};
+
+static inline size_t
+tbl_size(daysi_t from, daysi_t till)
+{
+	return sizeof(struct trod_tbl_s) +
+		(till - from + 1U) * sizeof(struct trod_day_s);
+}
+
+DEFUN trod_tbl_t
+make_trod_tbl(trod_t td, daysi_t from, daysi_t till)
+{
+	trod_cursor_t cur;
+	trod_tbl_t res;
+	size_t z;
+	uint32_t nchg = 0U;
+
+	if (UNLIKELY(till < from)) {
+		return NULL;
+	}
+	z = tbl_size(from, till);
+	/* anonymous maps come zeroed, pads and all */
+	if ((res = mmap(NULL, z, PROT_MEM, MAP_MEM, -1, 0)) == MAP_FAILED) {
+		return NULL;
+	}
+	memcpy(res->magic, TROD_TBL_MAGIC, sizeof(res->magic));
+	res->ver = TROD_TBL_VER;
+	res->endian = TROD_BIN_ENDIAN;
+	res->from = from;
+	res->till = till;
+
+	cur = make_trod_cursor(td);
+	for (daysi_t d = from; d <= till; d++) {
+		trod_instant_t inst = daysi_to_trod_instant(d);
+		struct trod_day_s *dp = res->day + (d - from);
+		uint64_t act = 0U;
+		int k;
+
+		nchg += trod_cursor_advance(cur, inst);
+		for (k = 0; (k = gbs_next_set(cur->active, k)) >= 0; k++) {
+			if (UNLIKELY(k >= 64)) {
+				/* doesn't fit */
+				break;
+			}
+			act |= 1ULL << k;
+		}
+		if (UNLIKELY(k >= 0)) {
+			free_trod_cursor(cur);
+			munmap(res, z);
+			return NULL;
+		}
+		dp->act = act;
+		dp->nchg = nchg;
+	}
+	free_trod_cursor(cur);
+	return res;
+}
+
+DEFUN trod_tbl_t
+read_trod_tbl(const char *file)
+{
+	const struct trod_tbl_s *hdr;
+	struct stat st;
+	void *map;
+	int fd;
+
+	if ((fd = open(file, O_RDONLY)) < 0) {
+		return NULL;
+	} else if (fstat(fd, &st) < 0 ||
+		   (size_t)st.st_size < sizeof(*hdr)) {
+		close(fd);
+		return NULL;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return NULL;
+	}
+	hdr = map;
+	if (memcmp(hdr->magic, TROD_TBL_MAGIC, sizeof(hdr->magic)) ||
+	    hdr->ver != TROD_TBL_VER || hdr->endian != TROD_BIN_ENDIAN ||
+	    hdr->till < hdr->from ||
+	    tbl_size(hdr->from, hdr->till) != (size_t)st.st_size) {
+		/* no table, or from a host of different byte order */
+		munmap(map, st.st_size);
+		return NULL;
+	}
+	return map;
+}
+
+DEFUN int
+write_trod_tbl(trod_tbl_t tbl, FILE *whither)
+{
+	size_t z = tbl_size(tbl->from, tbl->till);
+
+	if (fwrite(tbl, z, 1U, whither) < 1U ||
+	    fflush(whither) < 0 || ferror(whither)) {
+		return -1;
+	}
+	return 0;
+}
+
+DEFUN void
+free_trod_tbl(trod_tbl_t tbl)
+{
+	munmap(tbl, tbl_size(tbl->from, tbl->till));
+	return;
+}
+
+DEFUN const struct trod_day_s*
+trod_tbl_day(trod_tbl_t tbl, daysi_t d)
+{
+	if (UNLIKELY(d < tbl->from || d > tbl->till)) {
+		return NULL;
+	}
+	return tbl->day + (d - tbl->from);
+}
+
+
+/* k-way merges */
+struct __mrg_ent_s {
+	uint64_t key;
+	size_t src;
+	size_t i;
+};
+
+struct trod_mrg_s {
+	/* number of sources with events left, they form a heap */
+	size_t n;
+	const trod_t *td;
+	struct __mrg_ent_s h[];
+};
+
+static inline bool
+mrg_lt_p(const struct __mrg_ent_s *x, const struct __mrg_ent_s *y)
+{
+/* earlier instants first, the lower source first at the same instant */
+	return x->key < y->key || (x->key == y->key && x->src < y->src);
+}
+
+static void
+mrg_sift_down(struct trod_mrg_s *m, size_t k)
+{
+	struct __mrg_ent_s x = m->h[k];
+
+	for (size_t c; (c = 2U * k + 1U) < m->n; k = c) {
+		if (c + 1U < m->n && mrg_lt_p(m->h + c + 1U, m->h + c)) {
+			c++;
+		}
+		if (!mrg_lt_p(m->h + c, &x)) {
+			break;
+		}
+		m->h[k] = m->h[c];
+	}
+	m->h[k] = x;
+	return;
+}
+
+DEFUN trod_mrg_t
+make_trod_mrg(const trod_t *td, size_t ntd)
+{
+	trod_mrg_t res = malloc(sizeof(*res) + ntd * sizeof(*res->h));
+
+	res->n = 0U;
+	res->td = td;
+	for (size_t k = 0; k < ntd; k++) {
+		if (td[k]->ninst == 0U) {
+			continue;
+		}
+		res->h[res->n++] = (struct __mrg_ent_s){
+			trod_inst_key(td[k]->ev[0U]->when), k, 0U,
+		};
+	}
+	for (size_t k = res->n / 2U; k-- > 0U;) {
+		mrg_sift_down(res, k);
+	}
+	return res;
+}
+
+DEFUN void
+free_trod_mrg(trod_mrg_t m)
+{
+	free(m);
+	return;
+}
+
+DEFUN struct trod_event_s*
+trod_mrg_next(trod_mrg_t m, size_t *src)
+{
+	struct __mrg_ent_s *top = m->h;
+	trod_event_t res;
+	trod_t td;
+
+	if (UNLIKELY(m->n == 0U)) {
+		return NULL;
+	}
+	td = m->td[top->src];
+	res = td->ev[top->i];
+	if (src != NULL) {
+		*src = top->src;
+	}
+	/* refill from the same source or shrink the heap */
+	if (++top->i < td->ninst) {
+		top->key = trod_inst_key(td->ev[top->i]->when);
+	} else {
+		*top = m->h[--m->n];
+	}
+	mrg_sift_down(m, 0U);
 	return res;
 }
 #endif	/* !STANDALONE */
@@ -437,6 +1185,12 @@ struct cline_s {
 
 struct trsch_s {
 	size_t np;
+	void *vix;
+	void *memo;
+	void *map;
+	size_t mapsz;
+	char *deps;
+	size_t depsz;
 	struct cline_s *p[];
 };
 
@@ -479,50 +1233,442 @@ troq_add_cline(trod_event_t qi, const struct cline_s *p, daysi_t when)
 	return -1;
 }
 
-static void
-troq_add_clines(struct troq_s q[static 1], trsch_t sch, daysi_t when)
+/* events as found by cline_events(), to be sorted into a troq */
+struct clev_s {
+	daysi_t when;
+	unsigned int cl;
+	struct trod_state_s st;
+};
+
+static int
+clev_cmp(const void *x, const void *y)
+{
+	const struct clev_s *ex = x;
+	const struct clev_s *ey = y;
+
+	if (ex->when != ey->when) {
+		return ex->when < ey->when ? -1 : 1;
+	}
+	return ex->cl < ey->cl ? -1 : ex->cl > ey->cl;
+}
+
+static int
+daysi_cmp(const void *x, const void *y)
 {
-	static struct {
+	const daysi_t *dx = x;
+	const daysi_t *dy = y;
+
+	return *dx < *dy ? -1 : *dx > *dy;
+}
+
+static size_t
+cline_events(
+	struct clev_s **ev, size_t *zev, size_t nev,
+	const struct cline_s *p, unsigned int cl, daysi_t from, daysi_t till)
+{
+/* append the events of cline P from FROM till TILL (inclusive) to EV,
+ * events can only happen on node dates so for every year we check just
+ * those, in the same way the day-by-day scan in troq_add_cline() does */
+	struct {
 		struct trod_event_s ev;
 		struct trod_state_s st;
 	} qi;
+	int y0 = daysi_to_year(from);
+	int y1 = daysi_to_year(till);
+	daysi_t bp[p->nn];
 
-	qi.ev.when = daysi_to_trod_instant(when);
-	for (size_t i = 0; i < sch->np; i++) {
-		const struct cline_s *p = sch->p[i];
-
-		/* check year validity */
-		if (when < p->valid_from || when > p->valid_till) {
-			/* cline isn't applicable */
-			;
-		} else if (troq_add_cline(&qi.ev, p, when) < 0) {
-			/* nothing added then */
-			;
-		} else {
-			/* just add the guy */
-			troq_add_event(q, &qi.ev);
+	for (int y = y0; y <= y1; y++) {
+		size_t nbp = 0U;
+
+		/* collect this year's break points */
+		for (size_t j = 0; j < p->nn; j++) {
+			daysi_t l = daysi_in_year(p->n[j].l, y);
+
+			if (l < from || l > till || daysi_to_year(l) != y) {
+				continue;
+			}
+			bp[nbp++] = l;
+		}
+		qsort(bp, nbp, sizeof(*bp), daysi_cmp);
+
+		for (size_t k = 0; k < nbp; k++) {
+			if (k && bp[k] == bp[k - 1U]) {
+				/* checked that one already */
+				continue;
+			} else if (troq_add_cline(&qi.ev, p, bp[k]) < 0) {
+				/* nothing happened */
+				continue;
+			} else if (nev >= *zev) {
+				*zev = (*zev * 2U) ?: 256U;
+				*ev = realloc(*ev, *zev * sizeof(**ev));
+			}
+			(*ev)[nev].when = bp[k];
+			(*ev)[nev].cl = cl;
+			(*ev)[nev].st = qi.st;
+			nev++;
 		}
 	}
+	return nev;
+}
+
+/* conversion by year, each year is a bin of events of its own */
+struct __conv_s {
+	trsch_t sch;
+	size_t nbin;
+	struct __conv_bin_s {
+		/* days covered, till is exclusive */
+		daysi_t from;
+		daysi_t till;
+		size_t nev;
+		struct clev_s *ev;
+	} *bin;
+	/* next bin to be converted */
+	size_t next;
+};
+
+static void*
+conv_worker(void *clo)
+{
+	struct __conv_s *cv = clo;
+	const trsch_t sch = cv->sch;
+	size_t b;
+
+	/* bins don't share anything but the schema, which is
+	 * only ever read, so just grab the next one */
+	while ((b = __sync_fetch_and_add(&cv->next, 1U)) < cv->nbin) {
+		struct __conv_bin_s *bin = cv->bin + b;
+		size_t zev = 0U;
+
+		/* gather the events of every cline within its validity,
+		 * then bring them in order, day by day and cline by cline */
+		for (size_t i = 0; i < sch->np; i++) {
+			const struct cline_s *p = sch->p[i];
+			daysi_t f = p->valid_from > bin->from
+				? p->valid_from : bin->from;
+			daysi_t t = p->valid_till < bin->till - 1U
+				? p->valid_till : bin->till - 1U;
+
+			if (f <= t) {
+				bin->nev = cline_events(
+					&bin->ev, &zev, bin->nev, p, i, f, t);
+			}
+		}
+		qsort(bin->ev, bin->nev, sizeof(*bin->ev), clev_cmp);
+	}
+	return NULL;
+}
+
+
+/* event filters */
+struct trflt_yr_s {
+	unsigned int lo;
+	unsigned int hi;
+	bool keep;
+};
+
+struct trflt_s {
+	/* bit M set to drop contract month M */
+	unsigned int mdrop;
+	/* bit V set to drop states of value V, i.e. off, on, roll */
+	unsigned int vdrop;
+	/* days to shift instants by */
+	int shift;
+	/* contract year ranges to keep or drop, all of them apply */
+	size_t nyr;
+	struct trflt_yr_s *yr;
+};
+
+static int
+flt_add_line(struct trflt_s f[static 1], char *line)
+{
+/* rules look like
+ * keep|drop month MONTHS
+ * keep|drop year YEAR[-YEAR]
+ * keep|drop event on|off|roll ...
+ * shift [+-]DAYS
+ * return -1 if LINE isn't one of them */
+	static const char ws[] = " \t\n";
+	char *sp;
+	char *verb;
+	char *what;
+	char *arg;
+	bool keep;
+
+	if ((verb = strtok_r(line, ws, &sp)) == NULL || *verb == '#') {
+		/* empty line or comment */
+		return 0;
+	} else if (!strcmp(verb, "shift")) {
+		char *on;
+
+		if ((arg = strtok_r(NULL, ws, &sp)) == NULL) {
+			return -1;
+		}
+		f->shift += strtol(arg, &on, 10);
+		return on > arg && (*on == '\0' || !strcmp(on, "d")) ? 0 : -1;
+	} else if (!strcmp(verb, "keep")) {
+		keep = true;
+	} else if (!strcmp(verb, "drop")) {
+		keep = false;
+	} else {
+		return -1;
+	}
+
+	if ((what = strtok_r(NULL, ws, &sp)) == NULL) {
+		return -1;
+	} else if ((arg = strtok_r(NULL, ws, &sp)) == NULL) {
+		return -1;
+	} else if (!strcmp(what, "month")) {
+		unsigned int ms = 0U;
+
+		for (const char *ap = arg; *ap; ap++) {
+			unsigned int m;
+
+			if (!(m = m_to_i(*ap))) {
+				return -1;
+			}
+			ms |= 1U << m;
+		}
+		f->mdrop |= keep ? ~ms : ms;
+	} else if (!strcmp(what, "year")) {
+		struct trflt_yr_s yr = {.keep = keep};
+		char *on;
+
+		yr.lo = yr.hi = strtoul(arg, &on, 10);
+		if (*on == '-') {
+			yr.hi = strtoul(on + 1U, &on, 10);
+		}
+		if (*on || yr.hi < yr.lo) {
+			return -1;
+		}
+		f->yr = realloc(f->yr, (f->nyr + 1U) * sizeof(*f->yr));
+		f->yr[f->nyr++] = yr;
+	} else if (!strcmp(what, "event")) {
+		unsigned int vs = 0U;
+
+		do {
+			if (!strcmp(arg, "off")) {
+				vs |= 1U << 0U;
+			} else if (!strcmp(arg, "on")) {
+				vs |= 1U << 1U;
+			} else if (!strcmp(arg, "roll")) {
+				vs |= 1U << 2U;
+			} else {
+				return -1;
+			}
+		} while ((arg = strtok_r(NULL, ws, &sp)) != NULL);
+		f->vdrop |= keep ? ~vs : vs;
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+static int
+read_filter(struct trflt_s f[static 1], const char *file)
+{
+/* compile the rules in FILE into F */
+	char *line = NULL;
+	size_t llen = 0U;
+	size_t nln = 0U;
+	int res = 0;
+	FILE *fp;
+
+	if ((fp = fopen(file, "r")) == NULL) {
+		fprintf(stderr, "unable to open file %s\n", file);
+		return -1;
+	}
+	while (getline(&line, &llen, fp) > 0) {
+		nln++;
+		if (flt_add_line(f, line) < 0) {
+			fprintf(stderr, "%s:%zu: filter rule unreadable\n",
+				file, nln);
+			res = -1;
+			break;
+		}
+	}
+	if (line != NULL) {
+		free(line);
+	}
+	fclose(fp);
+	return res;
+}
+
+static void
+free_filter(struct trflt_s f[static 1])
+{
+	if (f->yr != NULL) {
+		free(f->yr);
+	}
 	return;
 }
 
-static trod_t
-schema_to_trod(trsch_t sch, idate_t from, idate_t till)
+static bool
+flt_pass_p(const struct trflt_s *f, struct trod_state_s st)
 {
-	struct troq_s q = {0UL, 0UL};
+	unsigned int y = trym_yr(st.ym);
+
+	if ((f->mdrop >> trym_mo(st.ym)) & 1U) {
+		return false;
+	} else if ((f->vdrop >> st.val) & 1U) {
+		return false;
+	}
+	for (size_t i = 0; i < f->nyr; i++) {
+		bool in = f->yr[i].lo <= y && y <= f->yr[i].hi;
+
+		if (in != f->yr[i].keep) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void
+flt_trod(trod_t td, const struct trflt_s *f)
+{
+/* filter TD in place, instants without states are removed altogether */
+	size_t ninst = 0U;
+	size_t nev = 0U;
+
+	for (size_t i = 0; i < td->ninst; i++) {
+		trod_event_t ev = td->ev[i];
+		size_t w = 0U;
+
+		for (const struct trod_state_s *s = ev->what; s->ym; s++) {
+			if (flt_pass_p(f, *s)) {
+				ev->what[w++] = *s;
+			}
+		}
+		if (w == 0U) {
+			continue;
+		}
+		ev->what[w] = (struct trod_state_s){0};
+		if (f->shift) {
+			trod_instant_t x = ev->when;
+			idate_t dt = x.y * 10000U + x.m * 100U + x.d;
+
+			ev->when = daysi_to_trod_instant(
+				idate_to_daysi(dt) + f->shift);
+			ev->when.H = x.H;
+			ev->when.M = x.M;
+			ev->when.S = x.S;
+			ev->when.ms = x.ms;
+		}
+		if (td->key != NULL) {
+			td->key[ninst] = trod_inst_ev_key(ev->when);
+		}
+		td->ev[ninst++] = ev;
+		nev += w;
+	}
+	td->ninst = ninst;
+	td->nev = nev;
+	/* snapshots are void now, cursors will replay from the start */
+	td->nsnap = 0U;
+	return;
+}
+
+static void
+conv_init(struct __conv_s cv[static 1], trsch_t sch, idate_t from, idate_t till)
+{
+/* split [FROM, TILL) into years, one bin each */
 	daysi_t fsi = idate_to_daysi(from);
 	daysi_t tsi = idate_to_daysi(till);
+
+	*cv = (struct __conv_s){.sch = sch};
+	if (fsi < tsi) {
+		int y0 = daysi_to_year(fsi);
+		int y1 = daysi_to_year(tsi - 1U);
+
+		cv->nbin = y1 - y0 + 1;
+		cv->bin = calloc(cv->nbin, sizeof(*cv->bin));
+		for (size_t b = 0; b < cv->nbin; b++) {
+			int y = y0 + (int)b;
+
+			cv->bin[b].from = idate_to_daysi(y * 10000U + 101U);
+			cv->bin[b].till = idate_to_daysi((y + 1) * 10000U + 101U);
+		}
+		cv->bin[0U].from = fsi;
+		cv->bin[cv->nbin - 1U].till = tsi;
+	}
+	return;
+}
+
+static void
+conv_run(const struct __conv_s cv[static 1], size_t b0, size_t nb,
+	 unsigned int njobs)
+{
+/* convert bins B0 up to B0 + NB of CV on NJOBS threads */
+	struct __conv_s sub = {
+		.sch = cv->sch,
+		.nbin = nb,
+		.bin = cv->bin + b0,
+		.next = 0U,
+	};
+
+	if (njobs > nb) {
+		njobs = nb ?: 1U;
+	}
+
+	{
+		pthread_t th[njobs];
+		unsigned int nth = 0U;
+
+		while (nth + 1U < njobs &&
+		       pthread_create(th + nth, NULL, conv_worker, &sub) == 0) {
+			nth++;
+		}
+		/* the main thread is a worker too, it drains whatever is
+		 * left should fewer threads have come up */
+		conv_worker(&sub);
+		for (unsigned int j = 0U; j < nth; j++) {
+			pthread_join(th[j], NULL);
+		}
+	}
+	return;
+}
+
+static trod_t
+schema_to_trod(
+	trsch_t sch, idate_t from, idate_t till, unsigned int njobs,
+	const struct trflt_s *flt)
+{
+	struct troq_s q = {0UL, 0UL};
+	struct troq_ev1_s qi;
+	struct __conv_s cv;
 	trod_t res;
 
-	for (daysi_t now = fsi; now < tsi; now++) {
-		troq_add_clines(&q, sch, now);
+	conv_init(&cv, sch, from, till);
+	conv_run(&cv, 0U, cv.nbin, njobs);
+
+	/* bins are in order, so just concatenate them */
+	for (size_t b = 0; b < cv.nbin; b++) {
+		const struct __conv_bin_s *bin = cv.bin + b;
+
+		for (size_t k = 0; k < bin->nev; k++) {
+			daysi_t when = bin->ev[k].when;
+
+			if (flt != NULL) {
+				/* filter right away */
+				if (!flt_pass_p(flt, bin->ev[k].st)) {
+					continue;
+				}
+				when += flt->shift;
+			}
+			qi.ev.when = daysi_to_trod_instant(when);
+			qi.st = bin->ev[k].st;
+			troq_add_event(&q, &qi.ev);
+		}
+		if (bin->ev != NULL) {
+			free(bin->ev);
+		}
+	}
+	if (cv.bin != NULL) {
+		free(cv.bin);
 	}
 
 	res = troq_to_trod(q);
 	return res;
 }
 
-
 #undef DEFUN
 #undef DECLF
 #define DECLF		static
@@ -530,40 +1676,48 @@ schema_to_trod(trsch_t sch, idate_t from, idate_t till)
 #include "gbs.h"
 #include "gbs.c"
 
-/* bitset for active contracts */
-static struct gbs_s active[1U];
+/* printer state */
+struct __pr_st_s {
+	/* bitset for active contracts */
+	struct gbs_s active[1U];
+	/* year of the last event printed */
+	unsigned int last_y;
+	/* appended to every line if non-NULL */
+	const char *tag;
+};
 
 static void
-activate(int ry, unsigned int m)
+activate(gbs_t active, int ry, unsigned int m)
 {
 	gbs_set(active, 12 * ry + (m - 1));
 	return;
 }
 
 static void
-deactivate(int ry, unsigned int m)
+deactivate(gbs_t active, int ry, unsigned int m)
 {
 	gbs_unset(active, 12 * ry + (m - 1));
 	return;
 }
 
 static int
-activep(int ry, unsigned int m)
+activep(gbs_t active, int ry, unsigned int m)
 {
 	return gbs_set_p(active, 12 * ry + (m - 1));
 }
 
 static void
-flip_over(int ry)
+flip_over(gbs_t active, int ry)
 {
 /* flip over to a new year in the ACTIVE bitset */
 	gbs_shift_lsb(active, 12 * ry);
 	return;
 }
 
+
 
 static void
-print_trod_event(trod_event_t ev, FILE *whither)
+print_trod_event(struct __pr_st_s *st, trod_event_t ev, FILE *whither)
 {
 	char buf[64];
 	char *p = buf;
@@ -579,11 +1733,11 @@ print_trod_event(trod_event_t ev, FILE *whither)
 
 		if (!s->val) {
 			*p++ = '~';
-			deactivate(ry, m);
-		} else if (s->val > 1U && activep(ry, m)) {
+			deactivate(st->active, ry, m);
+		} else if (s->val > 1U && activep(st->active, ry, m)) {
 			continue;
 		} else {
-			activate(ry, m);
+			activate(st->active, ry, m);
 		}
 
 		if (!opt_oco) {
@@ -599,6 +1753,10 @@ print_trod_event(trod_event_t ev, FILE *whither)
 				"%u%02u", y, m);
 		}
 
+		if (st->tag != NULL) {
+			p += snprintf(
+				p, sizeof(buf) - (p - buf), "%s", st->tag);
+		}
 		*p++ = '\n';
 		*p = '\0';
 		fputs(buf, whither);
@@ -607,19 +1765,18 @@ print_trod_event(trod_event_t ev, FILE *whither)
 }
 
 static void
-print_flip_over(trod_event_t ev, FILE *whither)
+print_flip_over(struct __pr_st_s *st, trod_event_t ev, FILE *whither)
 {
-	static unsigned int last_y;
 	char buf[64];
 	char *p = buf;
 	char *var;
 	unsigned int y = ev->when.y;
 	unsigned int ry;
 
-	if (UNLIKELY(last_y == 0 || last_y > y)) {
-		last_y = y;
+	if (UNLIKELY(st->last_y == 0 || st->last_y > y)) {
+		st->last_y = y;
 		return;
-	} else if (LIKELY((ry = (y - last_y)) == 0U)) {
+	} else if (LIKELY((ry = (y - st->last_y)) == 0U)) {
 		return;
 	} else if (opt_abs || opt_oco) {
 		goto flip_over;
@@ -630,49 +1787,197 @@ print_flip_over(trod_event_t ev, FILE *whither)
 	*p++ = '\t';
 	var = p;
 
-	for (size_t i = 0; i < active->nbits; i++, p = var) {
-		unsigned int yr = i / 12U;
-		unsigned int mo = i % 12U;
+	for (int k = 0;
+	     (k = gbs_next_set(st->active, k)) >= 0; k++, p = var) {
+		unsigned int yr = k / 12U;
+		unsigned int mo = k % 12U;
+		char cmo = i_to_m(mo + 1U);
 
-		if (activep(yr, mo + 1U)) {
-			char cmo = i_to_m(mo + 1U);
+		p += snprintf(
+			p, sizeof(buf) - (p - buf),
+			"%c%u->%c%d",
+			cmo, yr, cmo, (int)yr - (int)ry);
 
+		if (st->tag != NULL) {
 			p += snprintf(
-				p, sizeof(buf) - (p - buf),
-				"%c%u->%c%d",
-				cmo, yr, cmo, (int)yr - (int)ry);
-
-			*p++ = '\n';
-			*p = '\0';
-			fputs(buf, whither);
+				p, sizeof(buf) - (p - buf), "%s", st->tag);
 		}
+		*p++ = '\n';
+		*p = '\0';
+		fputs(buf, whither);
 	}
 flip_over:
 	/* now do the flip-over and reprint */
-	flip_over(ry);
-	last_y = y;
+	flip_over(st->active, ry);
+	st->last_y = y;
 	return;
 }
 
 static void
 print_trod(trod_t td, FILE *whither)
 {
+	struct __pr_st_s st = {.last_y = 0U};
+
 	/* initialise the flip-over book-keeper */
-	init_gbs(active, 12U * 30U);
+	init_gbs(st.active, 12U * 30U);
 
 	for (size_t i = 0; i < td->ninst; i++) {
 		trod_event_t x = td->ev[i];
 
-		print_flip_over(x, whither);
-		print_trod_event(x, whither);
+		print_flip_over(&st, x, whither);
+		print_trod_event(&st, x, whither);
 	}
 
-	fini_gbs(active);
+	fini_gbs(st.active);
+	return;
+}
+
+static void
+stream_schema(
+	trsch_t sch, idate_t from, idate_t till, unsigned int njobs,
+	const struct trflt_s *flt, FILE *whither)
+{
+/* like print_trod(schema_to_trod(...)) but without the trod in between,
+ * NJOBS years are converted at a time and printed right away, so only
+ * those and the active contracts are ever held in memory */
+	struct __pr_st_s st = {.last_y = 0U};
+	struct __conv_s cv;
+	/* clines yield at most one state per day each */
+	trod_event_t x = malloc(
+		sizeof(*x) + (sch->np + 1U) * sizeof(*x->what));
+	daysi_t xd = 0U;
+	size_t nw = 0U;
+
+	init_gbs(st.active, 12U * 30U);
+	conv_init(&cv, sch, from, till);
+	njobs = njobs ?: 1U;
+
+	for (size_t b0 = 0; b0 < cv.nbin; b0 += njobs) {
+		size_t nb = cv.nbin - b0 < njobs ? cv.nbin - b0 : njobs;
+
+		conv_run(&cv, b0, nb, njobs);
+		for (size_t b = b0; b < b0 + nb; b++) {
+			struct __conv_bin_s *bin = cv.bin + b;
+
+			for (size_t k = 0; k < bin->nev; k++) {
+				daysi_t when = bin->ev[k].when;
+
+				if (flt != NULL) {
+					if (!flt_pass_p(flt, bin->ev[k].st)) {
+						continue;
+					}
+					when += flt->shift;
+				}
+				if (nw && when != xd) {
+					/* instant complete, print it */
+					x->what[nw] = (struct trod_state_s){0};
+					print_flip_over(&st, x, whither);
+					print_trod_event(&st, x, whither);
+					nw = 0U;
+				}
+				if (nw == 0U) {
+					x->when = daysi_to_trod_instant(when);
+					xd = when;
+				}
+				x->what[nw++] = bin->ev[k].st;
+			}
+			if (bin->ev != NULL) {
+				free(bin->ev);
+				bin->ev = NULL;
+			}
+		}
+	}
+	if (nw) {
+		/* the last instant */
+		x->what[nw] = (struct trod_state_s){0};
+		print_flip_over(&st, x, whither);
+		print_trod_event(&st, x, whither);
+	}
+	if (cv.bin != NULL) {
+		free(cv.bin);
+	}
+	free(x);
+	fini_gbs(st.active);
 	return;
 }
 #endif	/* STANDALONE */
 
 
+#if defined STANDALONE
+static bool
+stdin_trod_bin_p(const char *file)
+{
+/* peek at stdin, if that's where FILE is, for a binary trod */
+	int c;
+
+	if (file != NULL && (file[0] != '-' || file[1] != '\0')) {
+		return false;
+	}
+	c = getc(stdin);
+	ungetc(c, stdin);
+	return c == TROD_BIN_MAGIC[0U];
+}
+
+static trod_t
+input_trod(
+	const char *file, idate_t from, idate_t till, unsigned int njobs,
+	const struct trflt_s *flt)
+{
+/* read FILE as schema and convert it or read it as trod,
+ * a NULL FILE means a schema or a binary trod on stdin */
+	trsch_t sch;
+	trod_t res;
+
+	if (stdin_trod_bin_p(file)) {
+		/* the schema reader would eat it, read it as trod */
+		res = read_trod("-");
+	} else if ((sch = read_schema(file ?: "-")) != NULL) {
+		res = schema_to_trod(sch, from, till, njobs, flt);
+		/* schema not needed anymore */
+		free_schema(sch);
+		return res;
+	} else if (file == NULL) {
+		return NULL;
+	} else {
+		res = read_trod(file);
+	}
+	if (res != NULL && flt != NULL) {
+		/* we're trod already, just filter */
+		flt_trod(res, flt);
+	}
+	return res;
+}
+
+static void
+print_merge(const trod_t *td, size_t ntd, FILE *whither)
+{
+/* print the events of all of TD in chronological order, each line
+ * tagged with the (1-based) index of its trod */
+	struct __pr_st_s st[ntd];
+	char tag[ntd][24U];
+	trod_mrg_t m = make_trod_mrg(td, ntd);
+	trod_event_t x;
+	size_t k;
+
+	memset(st, 0, sizeof(st));
+	for (k = 0; k < ntd; k++) {
+		snprintf(tag[k], sizeof(tag[k]), "\t%zu", k + 1U);
+		st[k].tag = tag[k];
+		init_gbs(st[k].active, 12U * 30U);
+	}
+	while ((x = trod_mrg_next(m, &k)) != NULL) {
+		print_flip_over(st + k, x, whither);
+		print_trod_event(st + k, x, whither);
+	}
+	for (k = 0; k < ntd; k++) {
+		fini_gbs(st[k].active);
+	}
+	free_trod_mrg(m);
+	return;
+}
+#endif	/* STANDALONE */
+
+
 #if defined STANDALONE
 #if defined __INTEL_COMPILER
 # pragma warning (disable:593)
@@ -687,10 +1992,14 @@ int
 main(int argc, char *argv[])
 {
 	struct tr_args_info argi[1];
-	trsch_t sch = NULL;
 	trod_t td = NULL;
+	struct trflt_s flt[1U] = {{0U}};
+	const struct trflt_s *fp = NULL;
+	const char *file;
+	trsch_t sch;
 	idate_t from;
 	idate_t till;
+	long int njobs;
 	int res = 0;
 
 	if (tr_parser(argc, argv, argi)) {
@@ -708,46 +2017,115 @@ main(int argc, char *argv[])
 	} else {
 		till = 20371231U;
 	}
+	if (argi->jobs_given) {
+		njobs = argi->jobs_arg;
+	} else {
+		njobs = sysconf(_SC_NPROCESSORS_ONLN);
+	}
 	if (argi->oco_given) {
 		opt_oco = 1;
 		opt_abs = 1;
 	} else if (argi->abs_given) {
 		opt_abs = 1;
 	}
-	if (argi->inputs_num > 0) {
-		sch = read_schema(argi->inputs[0]);
+	if (!argi->filter_given) {
+		;
+	} else if (read_filter(flt, argi->filter_arg) < 0) {
+		res = 1;
+		goto out;
 	} else {
-		sch = read_schema("-");
+		fp = flt;
+	}
+	if (njobs < 1) {
+		njobs = 1;
 	}
-	if (UNLIKELY(sch == NULL)) {
-		/* try the trod reader */
-		if (argi->inputs_num == 0 ||
-		    ((td = read_trod(argi->inputs[0])) == NULL)) {
-			fputs("schema unreadable\n", stderr);
+
+	if (argi->merge_given) {
+		const size_t ntd = argi->inputs_num;
+		trod_t tds[ntd + 1U];
+
+		if (ntd == 0U || argi->binary_given || argi->table_given) {
+			fputs("\
+--merge needs input files and can't be used with --binary or --table\n",
+			      stderr);
 			res = 1;
 			goto out;
-		} else if (td != NULL) {
-			/* we're trod already, do fuckall */
-			goto pr;
 		}
+		for (size_t k = 0; k < ntd; k++) {
+			tds[k] = input_trod(
+				argi->inputs[k], from, till,
+				(unsigned int)njobs, fp);
+			if (tds[k] == NULL) {
+				fprintf(stderr, "\
+schema unreadable: %s\n", argi->inputs[k]);
+				res = 1;
+			}
+		}
+		if (!res) {
+			print_merge(tds, ntd, stdout);
+		}
+		for (size_t k = 0; k < ntd; k++) {
+			if (tds[k] != NULL) {
+				free_trod(tds[k]);
+			}
+		}
+		goto out;
+	}
+
+	if (argi->binary_given && argi->table_given) {
+		fputs("--binary and --table are mutually exclusive\n", stderr);
+		res = 1;
+		goto out;
 	}
 
-	/* convert that schema goodness */
-	td = schema_to_trod(sch, from, till);
+	file = argi->inputs_num > 0 ? argi->inputs[0] : NULL;
+	if (argi->binary_given || argi->table_given ||
+	    stdin_trod_bin_p(file)) {
+		td = input_trod(file, from, till, (unsigned int)njobs, fp);
+	} else if ((sch = read_schema(file ?: "-")) != NULL) {
+		/* stream the conversion, no need for a trod */
+		stream_schema(sch, from, till, (unsigned int)njobs, fp, stdout);
+		free_schema(sch);
+		goto out;
+	} else if (file != NULL && (td = read_trod(file)) != NULL && fp) {
+		/* we're trod already, just filter */
+		flt_trod(td, fp);
+	}
+	if (UNLIKELY(td == NULL)) {
+		fputs("schema unreadable\n", stderr);
+		res = 1;
+		goto out;
+	}
 
-	/* schema not needed anymore */
-	free_schema(sch);
+	/* and print it again */
+	if (argi->table_given) {
+		trod_tbl_t tbl = make_trod_tbl(
+			td, idate_to_daysi(from), idate_to_daysi(till));
 
-	if (LIKELY(td != NULL)) {
-	pr:
-		/* and print it again */
+		if (tbl == NULL) {
+			fputs("\
+unable to tabulate trod, is --till before --from or are contracts \
+5 years or further out active?\n", stderr);
+			res = 1;
+		} else {
+			if (write_trod_tbl(tbl, stdout) < 0) {
+				fputs("unable to write trod table\n", stderr);
+				res = 1;
+			}
+			free_trod_tbl(tbl);
+		}
+	} else if (!argi->binary_given) {
 		print_trod(td, stdout);
-
-		/* and free the rest of our resources */
-		free_trod(td);
+	} else if (write_trod_bin(td, stdout) < 0) {
+		fputs("unable to write binary trod\n", stderr);
+		res = 1;
 	}
 
+	/* and free the rest of our resources */
+	free_trod(td);
+
 out:
+	free_filter(flt);
 	tr_parser_free(argi);
 	return res;
 }
@@ -37,20 +37,117 @@
 #if !defined INCLUDED_trod_h_
 #define INCLUDED_trod_h_
 
+#include "dt-strpf.h"
+
 #if !defined DECLF
 # define DECLF		extern
 # define DEFUN
 #endif	/* !DECLF */
 
 typedef struct trod_s *trod_t;
+typedef struct trod_cursor_s *trod_cursor_t;
+typedef struct trod_tbl_s *trod_tbl_t;
+typedef struct trod_mrg_s *trod_mrg_t;
+struct gbs_s;
+struct trod_event_s;
+
+/* entry of a trod table */
+struct trod_day_s {
+	/* contracts active at the end of the day, bit 12 * RY + M - 1 for
+	 * month M of the year RY years after the day's */
+	uint64_t act;
+	/* number of state changes since the beginning of the trod */
+	uint32_t nchg;
+	/* always 0 */
+	uint32_t pad;
+};
 
 
 /**
- * Read truffle roll-over schema from FILE. */
+ * Read truffle roll-over schema from FILE, in text or binary format. */
 DECLF trod_t read_trod(const char *file);
 
+/**
+ * Write TD to WHITHER in binary format, which read_trod() accepts on
+ * hosts of the same byte order.  Return 0 on success. */
+DECLF int write_trod_bin(trod_t td, FILE *whither);
+
 /**
  * Free resources associated with roll-over schema. */
 DECLF void free_trod(trod_t);
 
+/**
+ * Return a cursor to traverse TD chronologically while keeping track
+ * of the contracts active at the cursor's instant.  Cursors hold all
+ * of their state, so any number of them can be used at once. */
+DECLF trod_cursor_t make_trod_cursor(trod_t td);
+
+/**
+ * Free resources associated with the trod cursor, but not its trod. */
+DECLF void free_trod_cursor(trod_cursor_t);
+
+/**
+ * Move cursor to INST, starting over from the trod's last year flip
+ * before INST.
+ * Return the number of state changes since the beginning of the trod. */
+DECLF int trod_cursor_seek(trod_cursor_t, trod_instant_t inst);
+
+/**
+ * Move cursor forward to INST, or like trod_cursor_seek() if INST is
+ * before the cursor's instant.
+ * Return the number of state changes applied. */
+DECLF int trod_cursor_advance(trod_cursor_t, trod_instant_t inst);
+
+/**
+ * Like trod_cursor_advance() but to the instant packed into KEY,
+ * see trod_inst_key().  Events at all-day or all-second instants take
+ * effect at the start of their day or second. */
+DECLF int trod_cursor_advance_key(trod_cursor_t, uint64_t key);
+
+/**
+ * Return the set of contracts active at the cursor's instant, contract
+ * month M of the year RY years after the instant's is bit 12 * RY + M - 1. */
+DECLF struct gbs_s *trod_cursor_active(trod_cursor_t);
+
+/**
+ * Tabulate the contracts active on each of the days FROM to TILL
+ * as per TD.  The table is a single block of memory without pointers.
+ * Return NULL if contracts 5 years or further out are active. */
+DECLF trod_tbl_t make_trod_tbl(trod_t td, daysi_t from, daysi_t till);
+
+/**
+ * Map the trod table in FILE as written by write_trod_tbl().
+ * Return NULL if FILE is no trod table or is from a host of different
+ * byte order. */
+DECLF trod_tbl_t read_trod_tbl(const char *file);
+
+/**
+ * Write the trod table to WHITHER.  Return 0 on success. */
+DECLF int write_trod_tbl(trod_tbl_t, FILE *whither);
+
+/**
+ * Free resources associated with the trod table. */
+DECLF void free_trod_tbl(trod_tbl_t);
+
+/**
+ * Return the entry for day D in the trod table or NULL if D is not
+ * covered by the table. */
+DECLF const struct trod_day_s *trod_tbl_day(trod_tbl_t, daysi_t d);
+
+/**
+ * Prepare a k-way merge of the NTD trods in TD, which must outlive
+ * the merge. */
+DECLF trod_mrg_t make_trod_mrg(const trod_t *td, size_t ntd);
+
+/**
+ * Free resources associated with the merge, but not its trods. */
+DECLF void free_trod_mrg(trod_mrg_t);
+
+/**
+ * Return the next event of the merge in chronological order and put
+ * the index of the trod it comes from into SRC, events of the same
+ * instant are returned in the order of their trods.
+ * Return NULL when all trods are exhausted. */
+DECLF struct trod_event_s *trod_mrg_next(trod_mrg_t, size_t *src);
+
 #endif	/* INCLUDED_trod_h_ */
@@ -45,6 +45,7 @@
 #include <string.h>
 #include <ctype.h>
 #include <math.h>
+#include <pthread.h>
 #include <sys/mman.h>
 #if defined WORDS_BIGENDIAN
 # include <limits.h>
@@ -153,6 +154,21 @@ struct __cutflo_st_s {
 	double *expos;
 	double cum_flo;
 	double inc_flo;
+
+	/* components of the cut as of its generation GEN, kept across
+	 * calls so unchanged cuts needn't be walked again, and cuts whose
+	 * composition is unchanged (generation CGEN) needn't be resolved */
+	size_t gen;
+	size_t cgen;
+	size_t nlive;
+	struct __cutflo_cc_s {
+		/* index into the cut's components */
+		size_t i;
+		trym_t ym;
+		/* index into the series, or -1 */
+		ssize_t idx;
+		double expo;
+	} *live;
 };
 
 static void
@@ -169,6 +185,10 @@ init_cutflo_st(
 	st->expos = calloc(series->ncons, sizeof(*st->expos));
 	st->cum_flo = 0.0;
 	st->inc_flo = 0.0;
+	st->gen = 0U;
+	st->cgen = 0U;
+	st->nlive = 0U;
+	st->live = NULL;
 	return;
 }
 
@@ -177,6 +197,54 @@ free_cutflo_st(struct __cutflo_st_s *st)
 {
 	free(st->bases);
 	free(st->expos);
+	if (st->live != NULL) {
+		free(st->live);
+	}
+	return;
+}
+
+static void
+cutflo_walk(struct __cutflo_st_s *st, trcut_t c)
+{
+/* resolve the components of C against the series unless C is the
+ * very cut we've seen last time, i.e. nothing has been added, removed
+ * or changed since, if only exposures have changed just gather those */
+	if (st->live != NULL && c->gen == st->gen) {
+		return;
+	} else if (st->live != NULL && c->cgen == st->cgen) {
+		for (size_t k = 0; k < st->nlive; k++) {
+			const size_t i = st->live[k].i;
+
+			st->live[k].expo = c->comps[i].y * st->tick_val;
+		}
+		return;
+	}
+	st->live = realloc(st->live, (c->ncomps + 1U) * sizeof(*st->live));
+	st->nlive = 0U;
+	for (size_t i = 0; i < c->ncomps; i++) {
+		unsigned int mo = m_to_i(c->comps[i].month);
+		unsigned int yr = c->comps[i].year;
+		trym_t ym = cym_to_trym(yr, mo);
+
+		if (ym == 0) {
+			continue;
+		}
+		st->live[st->nlive].i = i;
+		st->live[st->nlive].ym = ym;
+		st->live[st->nlive].idx = tsc_find_cym_idx(st->tsc, ym);
+		st->live[st->nlive].expo = c->comps[i].y * st->tick_val;
+		st->nlive++;
+	}
+	return;
+}
+
+static void
+cutflo_done(struct __cutflo_st_s *st, trcut_t c, size_t nlive)
+{
+/* keep the first NLIVE components and remember C's generation */
+	st->nlive = nlive;
+	st->gen = c->gen;
+	st->cgen = c->cgen;
 	return;
 }
 
@@ -200,6 +268,7 @@ cut_flow(struct __cutflo_st_s *st, trcut_t c, idate_t dt)
 	double res = 0.0;
 	const double *new_v = NULL;
 	int is_non_nil = 0;
+	size_t n = 0U;
 
 	for (size_t i = st->dvv_idx; i < st->tsc->ndvvs; i++) {
 		/* assume sortedness */
@@ -211,25 +280,20 @@ cut_flow(struct __cutflo_st_s *st, trcut_t c, idate_t dt)
 			break;
 		}
 	}
-	for (size_t i = 0; i < c->ncomps; i++) {
-		unsigned int mo = m_to_i(c->comps[i].month);
-		unsigned int yr = c->comps[i].year;
-		trym_t ym = cym_to_trym(yr, mo);
-		double expo;
-		ssize_t idx;
+	cutflo_walk(st, c);
+	for (size_t k = 0; k < st->nlive; k++) {
+		const struct __cutflo_cc_s l = st->live[k];
+		const trym_t ym = l.ym;
+		const double expo = l.expo;
+		const ssize_t idx = l.idx;
 		double flo;
 
-		if (ym == 0) {
-			continue;
-		}
-		expo = c->comps[i].y * st->tick_val;
-
-		if ((idx = tsc_find_cym_idx(st->tsc, ym)) < 0 ||
-		    isnan(new_v[idx])) {
+		if (idx < 0 || isnan(new_v[idx])) {
 			if (expo != 0.0) {
 				warn_noquo(dt, ym, expo);
+				st->live[n++] = l;
 			} else {
-				cut_rem_cc(c, c->comps + i);
+				cut_rem_cc(c, c->comps + l.i);
 			}
 			continue;
 		}
@@ -268,11 +332,14 @@ cut_flow(struct __cutflo_st_s *st, trcut_t c, idate_t dt)
 		} else {
 			/* st->expos[idx] == 0.0 && st->expos[idx] == expo */
 			flo = 0.0;
-			cut_rem_cc(c, c->comps + i);
+			cut_rem_cc(c, c->comps + l.i);
+			continue;
 		}
 		/* munch it all together */
 		res += flo;
+		st->live[n++] = l;
 	}
+	cutflo_done(st, c, n);
 	st->was_non_nil = st->is_non_nil;
 	st->is_non_nil = is_non_nil;
 	st->inc_flo = res;
@@ -286,6 +353,7 @@ cut_base(struct __cutflo_st_s *st, trcut_t c, idate_t dt)
 	double res = 0.0;
 	const double *new_v = NULL;
 	int is_non_nil = 0;
+	size_t n = 0U;
 
 	for (size_t i = st->dvv_idx; i < st->tsc->ndvvs; i++) {
 		if (st->tsc->dvvs[i].d == dt) {
@@ -294,25 +362,20 @@ cut_base(struct __cutflo_st_s *st, trcut_t c, idate_t dt)
 			break;
 		}
 	}
-	for (size_t i = 0; i < c->ncomps; i++) {
-		unsigned int mo = m_to_i(c->comps[i].month);
-		unsigned int yr = c->comps[i].year;
-		trym_t ym = cym_to_trym(yr, mo);
-		double expo;
-		ssize_t idx;
+	cutflo_walk(st, c);
+	for (size_t k = 0; k < st->nlive; k++) {
+		const struct __cutflo_cc_s l = st->live[k];
+		const trym_t ym = l.ym;
+		const double expo = l.expo;
+		const ssize_t idx = l.idx;
 		double flo;
 
-		if (ym == 0) {
-			continue;
-		}
-		expo = c->comps[i].y * st->tick_val;
-
-		if ((idx = tsc_find_cym_idx(st->tsc, ym)) < 0 ||
-		    isnan(new_v[idx])) {
+		if (idx < 0 || isnan(new_v[idx])) {
 			if (expo != 0.0) {
 				warn_noquo(dt, ym, expo);
+				st->live[n++] = l;
 			} else {
-				cut_rem_cc(c, c->comps + i);
+				cut_rem_cc(c, c->comps + l.i);
 			}
 			continue;
 		}
@@ -333,11 +396,14 @@ cut_base(struct __cutflo_st_s *st, trcut_t c, idate_t dt)
 			is_non_nil = 1;
 		} else {
 			flo = 0.0;
-			cut_rem_cc(c, c->comps + i);
+			cut_rem_cc(c, c->comps + l.i);
+			continue;
 		}
 		/* munch it all together */
 		res += flo;
+		st->live[n++] = l;
 	}
+	cutflo_done(st, c, n);
 	st->was_non_nil = st->is_non_nil;
 	st->is_non_nil = is_non_nil;
 	st->inc_flo = res;
@@ -351,6 +417,7 @@ cut_sparse(struct __cutflo_st_s *st, trcut_t c, idate_t dt)
 	double res = 0.0;
 	const double *new_v = NULL;
 	int is_non_nil = 0;
+	size_t n = 0U;
 	int has_trans = 0;
 
 	for (size_t i = st->dvv_idx; i < st->tsc->ndvvs; i++) {
@@ -360,25 +427,20 @@ cut_sparse(struct __cutflo_st_s *st, trcut_t c, idate_t dt)
 			break;
 		}
 	}
-	for (size_t i = 0; i < c->ncomps; i++) {
-		unsigned int mo = m_to_i(c->comps[i].month);
-		unsigned int yr = c->comps[i].year;
-		trym_t ym = cym_to_trym(yr, mo);
-		double expo;
-		ssize_t idx;
+	cutflo_walk(st, c);
+	for (size_t k = 0; k < st->nlive; k++) {
+		const struct __cutflo_cc_s l = st->live[k];
+		const trym_t ym = l.ym;
+		const double expo = l.expo;
+		const ssize_t idx = l.idx;
 		double flo;
 
-		if (ym == 0) {
-			continue;
-		}
-		expo = c->comps[i].y * st->tick_val;
-
-		if ((idx = tsc_find_cym_idx(st->tsc, ym)) < 0 ||
-		    isnan(new_v[idx])) {
+		if (idx < 0 || isnan(new_v[idx])) {
 			if (expo != 0.0) {
 				warn_noquo(dt, ym, expo);
+				st->live[n++] = l;
 			} else {
-				cut_rem_cc(c, c->comps + i);
+				cut_rem_cc(c, c->comps + l.i);
 			}
 			continue;
 		}
@@ -412,11 +474,14 @@ cut_sparse(struct __cutflo_st_s *st, trcut_t c, idate_t dt)
 			/* st->expos[idx] == 0.0 && st->expos[idx] == expo */
 			flo = 0.0;
 			has_trans = 0;
-			cut_rem_cc(c, c->comps + i);
+			cut_rem_cc(c, c->comps + l.i);
+			continue;
 		}
 		/* munch it all together */
 		res += flo;
+		st->live[n++] = l;
 	}
+	cutflo_done(st, c, n);
 	st->has_trans = has_trans;
 	st->was_non_nil = st->is_non_nil;
 	st->is_non_nil = is_non_nil;
@@ -446,11 +511,30 @@ static cutflo_trans_t(*pick_cf_fun(struct __series_spec_s ser_sp))
 	}
 }
 
+static double
+cutflo_val(const struct __cutflo_st_s *st, struct __series_spec_s ser_sp)
+{
+/* the value to report as per SER_SP after a cut flow step */
+	if (LIKELY(!ser_sp.abs_dimen_p && ser_sp.cump)) {
+		return st->cum_flo + st->basis;
+	} else if (LIKELY(!ser_sp.abs_dimen_p)) {
+		return st->inc_flo;
+	} else if (LIKELY(!ser_sp.cump)) {
+		return st->inc_flo;
+	}
+	return st->cum_flo;
+}
+
 static void
-roll_over_series(
-	trsch_t s, trtsc_t ser, struct __series_spec_s ser_sp, FILE *whither)
+__roll_over_series(
+	trsch_t s, const_trtsc_t ser, struct __series_spec_s ser_sp,
+	FILE *whither, double *restrict vals)
 {
-	trcut_t c = NULL;
+/* roll S over SER and print the results to WHITHER if non-NULL,
+ * if VALS is non-NULL also put the value on the I-th date of SER into
+ * VALS[I], or NAN if there's nothing to report on that date */
+	trcur_t cur = make_cut_cursor(s);
+	trcut_t c;
 	struct __cutflo_st_s cfst;
 	cutflo_trans_t(*const cf)(struct __cutflo_st_s*, trcut_t, idate_t) =
 		pick_cf_fun(ser_sp);
@@ -465,172 +549,162 @@ roll_over_series(
 		idate_t dt = ser->dvvs[i].d;
 		daysi_t mc_ds = idate_to_daysi(dt);
 
+		if (vals != NULL) {
+			vals[i] = NAN;
+		}
 		/* anchor now contains the very first date and value */
-		if ((c = make_cut(c, s, mc_ds)) == NULL) {
+		if ((c = cut_cursor_advance(cur, mc_ds)) == NULL) {
 			continue;
 		}
 
 		if (cf(&cfst, c, dt) > trbit) {
 			char buf[32];
-			double val;
-
-			if (LIKELY(!ser_sp.abs_dimen_p && ser_sp.cump)) {
-				val = cfst.cum_flo + cfst.basis;
-			} else if (LIKELY(!ser_sp.abs_dimen_p)) {
-				val = cfst.inc_flo;
-			} else if (LIKELY(!ser_sp.cump)) {
-				val = cfst.inc_flo;
-			} else {
-				val = cfst.cum_flo;
+			double val = cutflo_val(&cfst, ser_sp);
+
+			if (vals != NULL) {
+				vals[i] = val;
+			}
+			if (whither != NULL) {
+				snprint_idate(buf, sizeof(buf), dt);
+				fprintf(whither, "%s\t%.8g\n", buf, val);
 			}
-			snprint_idate(buf, sizeof(buf), dt);
-			fprintf(whither, "%s\t%.8g\n", buf, val);
 		}
 	}
 
 	/* free resources */
-	if (c) {
-		free_cut(c);
-	}
+	free_cut_cursor(cur);
 	/* free up resources */
 	free_cutflo_st(&cfst);
 	return;
 }
 
-
-/* trod goodness */
-typedef struct trod_state_s *trod_state_t;
-typedef struct trod_event_s *trod_event_t;
-
-struct trod_state_s {
-	uint8_t val;
-	trym_t ym:TRYM_WIDTH;
-};
-
-struct trod_event_s {
-	trod_instant_t when;
-	struct trod_state_s what[];
-};
-
-/* trod container */
-struct trod_s {
-	size_t ninst;
-	size_t nev;
-	/* 0_event terminated list of events (NINST of them) */
-	trod_event_t ev[];
-};
-
-static inline void
-activate(gbs_t bs, int ry, unsigned int m)
+static void
+roll_over_series(
+	trsch_t s, trtsc_t ser, struct __series_spec_s ser_sp, FILE *whither)
 {
-	gbs_set(bs, 12 * ry + (m - 1));
+	__roll_over_series(s, ser, ser_sp, whither, NULL);
 	return;
 }
 
-static inline void
-deactivate(gbs_t bs, int ry, unsigned int m)
-{
-	gbs_unset(bs, 12 * ry + (m - 1));
-	return;
-}
 
-static inline int
-activep(gbs_t bs, int ry, unsigned int m)
-{
-	return gbs_set_p(bs, 12 * ry + (m - 1));
-}
+/* sweeps, i.e. many schemas rolled over the same series,
+ * shifts beyond a year are pointless, shift_schema() clamps anyway */
+#define SWEEP_MAX	(365)
 
-static inline void
-flip_over(gbs_t bs, int ry)
-{
-/* flip over to a new year in the ACTIVE bitset */
-	gbs_shift_lsb(bs, 12 * ry);
-	return;
-}
+struct __sweep_s {
+	const_trtsc_t ser;
+	struct __series_spec_s sp;
+	size_t nvar;
+	trsch_t *var;
+	/* NVAR columns of NDVVS values each */
+	double *vals;
+	/* next variant to be rolled */
+	size_t next;
+};
 
-static int
-update_gbs_ev(gbs_t bs, trod_event_t ev)
+static void*
+sweep_worker(void *clo)
 {
-	int res = 0;
+	struct __sweep_s *sw = clo;
+	size_t i;
 
-	for (const struct trod_state_s *s = ev->what; s->ym; s++) {
-		unsigned int m = trym_mo(s->ym);
-		unsigned int y = trym_yr(s->ym);
-		int ry = y - ev->when.y;
+	/* variants don't share anything but the series, which is
+	 * only ever read, so just grab the next one */
+	while ((i = __sync_fetch_and_add(&sw->next, 1U)) < sw->nvar) {
+		double *vals = sw->vals + i * sw->ser->ndvvs;
 
-		if (!s->val) {
-			deactivate(bs, ry, m);
-			res++;
-		} else if (s->val > 1U && activep(bs, ry, m)) {
-			continue;
-		} else {
-			activate(bs, ry, m);
-			res++;
-		}
+		__roll_over_series(sw->var[i], sw->ser, sw->sp, NULL, vals);
 	}
-	return res;
+	return NULL;
 }
 
 static int
-update_gbs(gbs_t bs, trod_t td, trod_instant_t inst)
+sweep_series(
+	trsch_t *var, size_t nvar, trtsc_t ser, struct __series_spec_s ser_sp,
+	unsigned int njobs, FILE *whither)
 {
-	static trod_instant_t last;
-	static size_t i;
-	int res = 0;
+	struct __sweep_s sw = {
+		.ser = ser,
+		.sp = ser_sp,
+		.nvar = nvar,
+		.var = var,
+		.next = 0U,
+	};
+	pthread_t *th;
+	unsigned int nth = 0U;
 
-	if (trod_inst_lt_p(inst, last)) {
-		/* we'll have to build it all up again */
-		last = (trod_instant_t){0};
-		i = 0;
+	if ((sw.vals = malloc(nvar * ser->ndvvs * sizeof(*sw.vals))) == NULL) {
+		return -1;
+	}
+	th = malloc(njobs * sizeof(*th));
+	while (th != NULL && nth + 1U < njobs &&
+	       pthread_create(th + nth, NULL, sweep_worker, &sw) == 0) {
+		nth++;
 	}
-	for (; i < td->ninst; i++) {
-		trod_event_t x = td->ev[i];
+	/* the main thread is a worker too, it drains whatever is left
+	 * should fewer threads have come up */
+	sweep_worker(&sw);
+	for (unsigned int j = 0U; j < nth; j++) {
+		pthread_join(th[j], NULL);
+	}
+	free(th);
+
+	/* one line per date, one column per variant */
+	for (size_t i = 0; i < ser->ndvvs; i++) {
+		char buf[32];
+		size_t k;
 
-		if (last.y < x->when.y) {
-			flip_over(bs, x->when.y - last.y);
+		for (k = 0; k < nvar && isnan(sw.vals[k * ser->ndvvs + i]); k++);
+		if (k >= nvar) {
+			continue;
 		}
-		if (trod_inst_lt_p(inst, x->when)) {
-			/* we went to far, aye? */
-			last = inst;
-			break;
+		snprint_idate(buf, sizeof(buf), ser->dvvs[i].d);
+		fputs(buf, whither);
+		for (k = 0; k < nvar; k++) {
+			double val = sw.vals[k * ser->ndvvs + i];
+
+			fputc('\t', whither);
+			if (!isnan(val)) {
+				fprintf(whither, "%.8g", val);
+			}
 		}
-		res += update_gbs_ev(bs, x);
-		last = x->when;
+		fputc('\n', whither);
 	}
-	return res;
+	free(sw.vals);
+	return 0;
 }
 
+
+/* trod goodness */
 static void
-print_contracts(gbs_t bs, trod_t td, trod_instant_t inst, struct trcut_pr_s opt)
+print_active(
+	struct gbs_s bs[static 1], trod_instant_t inst, struct trcut_pr_s opt)
 {
-	static char buf[256];
+	char buf[256];
 	char *q = buf;
 
-	update_gbs(bs, td, inst);
 	q += dt_strf(buf, sizeof(buf), inst);
 	*q++ = '\t';
-	for (size_t k = 0; k < bs->nbits; k++) {
+	for (int k = 0; (k = gbs_next_set(bs, k)) >= 0; k++) {
 		unsigned int yr = k / 12U;
 		unsigned int mo = k % 12U;
 
-		if (activep(bs, yr, mo + 1U)) {
-			if (opt.abs || opt.oco) {
-				yr += inst.y;
-			}
-			if (!opt.oco) {
-				*q++ = i_to_m(mo + 1U);
-			}
-			/* always print the year */
+		if (opt.abs || opt.oco) {
+			yr += inst.y;
+		}
+		if (!opt.oco) {
+			*q++ = i_to_m(mo + 1U);
+		}
+		/* always print the year */
+		q += snprintf(
+			q, sizeof(buf) - (q - buf),
+			"%u", yr);
+		if (opt.oco) {
 			q += snprintf(
 				q, sizeof(buf) - (q - buf),
-				"%u", yr);
-			if (opt.oco) {
-				q += snprintf(
-					q, sizeof(buf) - (q - buf),
-					"%02u", mo + 1U);
-			}
-			*q++ = ' ';
+				"%02u", mo + 1U);
 		}
+		*q++ = ' ';
 	}
 	q--;
 	*q++ = '\n';
@@ -639,29 +713,48 @@ print_contracts(gbs_t bs, trod_t td, trod_instant_t inst, struct trcut_pr_s opt)
 	return;
 }
 
+static void
+print_contracts(trod_cursor_t cur, trod_instant_t inst, struct trcut_pr_s opt)
+{
+	trod_cursor_advance(cur, inst);
+	print_active(trod_cursor_active(cur), inst, opt);
+	return;
+}
+
+static void
+print_contracts_tbl(
+	const struct trod_day_s *day, trod_instant_t inst, struct trcut_pr_s opt)
+{
+/* like print_contracts() but for an entry of a trod table */
+	struct gbs_s bs[1U];
+
+	init_gbs(bs, 64U);
+	for (uint64_t act = day->act; act; act &= act - 1U) {
+		gbs_set(bs, __builtin_ctzll(act));
+	}
+	print_active(bs, inst, opt);
+	fini_gbs(bs);
+	return;
+}
+
 static trcut_t
 make_cut_from_gbs(trcut_t cut, struct gbs_s bs[static 1], trod_instant_t inst)
 {
 	if (cut) {
 		/* quickly rinse the old cut */
-		for (size_t i = 0; i < cut->ncomps; i++) {
-			cut->comps[i].y = 0.0;
-		}
+		cut_rinse(cut);
 	}
-	for (size_t k = 0; k < bs->nbits; k++) {
+	for (int k = 0; (k = gbs_next_set(bs, k)) >= 0; k++) {
 		unsigned int yr = k / 12U;
 		unsigned int mo = k % 12U;
+		struct trcc_s cc;
 
-		if (activep(bs, yr, mo + 1U)) {
-			struct trcc_s cc;
-
-			cc.month = (uint8_t)i_to_m(mo + 1U);
-			cc.year = (uint16_t)(yr + inst.y);
-			cc.y = 1.0;
+		cc.month = (uint8_t)i_to_m(mo + 1U);
+		cc.year = (uint16_t)(yr + inst.y);
+		cc.y = 1.0;
 
-			/* add this cut cell */
-			cut = cut_add_cc(cut, cc);
-		}
+		/* add this cut cell */
+		cut = cut_add_cc(cut, cc);
 	}
 	return cut;
 }
@@ -670,7 +763,7 @@ static void
 trod_roll_over_series(
 	trod_t td, trtsc_t ser, struct __series_spec_s ser_sp, FILE *whither)
 {
-	struct gbs_s active[1] = {{0}};
+	trod_cursor_t tc = make_trod_cursor(td);
 	trcut_t c = NULL;
 	struct __cutflo_st_s cfst;
 	cutflo_trans_t(*const cf)(struct __cutflo_st_s*, trcut_t, idate_t) =
@@ -678,8 +771,6 @@ trod_roll_over_series(
 	const unsigned int trbit = UNLIKELY(ser_sp.sparsep)
 		? CUTFLO_HAS_TRANS_BIT : CUTFLO_TRANS_NON_NIL;
 
-	/* initialise the activity tracker */
-	init_gbs(active, 12U * 5U);
 	/* init out cut flow state structure */
 	init_cutflo_st(&cfst, ser, ser_sp.tick_val, ser_sp.basis);
 	/* traverse the series, it's chronological */
@@ -689,9 +780,9 @@ trod_roll_over_series(
 			idate_y(dt), idate_m(dt), idate_d(dt), TROD_ALL_DAY,
 		};
 
-		if (update_gbs(active, td, di)) {
+		if (trod_cursor_advance(tc, di)) {
 			/* update the cut */
-			c = make_cut_from_gbs(c, active, di);
+			c = make_cut_from_gbs(c, trod_cursor_active(tc), di);
 		}
 		/* do fuckall if cut is empty */
 		if (c == NULL) {
@@ -700,17 +791,93 @@ trod_roll_over_series(
 
 		if (cf(&cfst, c, dt) > trbit) {
 			char buf[32];
-			double val;
-
-			if (LIKELY(!ser_sp.abs_dimen_p && ser_sp.cump)) {
-				val = cfst.cum_flo + cfst.basis;
-			} else if (LIKELY(!ser_sp.abs_dimen_p)) {
-				val = cfst.inc_flo;
-			} else if (LIKELY(!ser_sp.cump)) {
-				val = cfst.inc_flo;
-			} else {
-				val = cfst.cum_flo;
-			}
+			double val = cutflo_val(&cfst, ser_sp);
+
+			snprint_idate(buf, sizeof(buf), dt);
+			fprintf(whither, "%s\t%.8g\n", buf, val);
+		}
+	}
+	/* free up resources */
+	if (c) {
+		free_cut(c);
+	}
+	free_cutflo_st(&cfst);
+	free_trod_cursor(tc);
+	return;
+}
+
+static trcut_t
+make_cut_from_act(trcut_t cut, uint64_t act, trod_instant_t inst)
+{
+/* like make_cut_from_gbs() but for a trod table's active mask */
+	if (cut) {
+		/* quickly rinse the old cut */
+		cut_rinse(cut);
+	}
+	for (; act; act &= act - 1U) {
+		unsigned int k = __builtin_ctzll(act);
+		unsigned int yr = k / 12U;
+		unsigned int mo = k % 12U;
+		struct trcc_s cc;
+
+		cc.month = (uint8_t)i_to_m(mo + 1U);
+		cc.year = (uint16_t)(yr + inst.y);
+		cc.y = 1.0;
+
+		/* add this cut cell */
+		cut = cut_add_cc(cut, cc);
+	}
+	return cut;
+}
+
+static int
+tbl_roll_over_series(
+	trod_tbl_t tbl, trtsc_t ser, struct __series_spec_s ser_sp,
+	FILE *whither)
+{
+/* like trod_roll_over_series() but look the active contracts up in TBL,
+ * which must cover the whole of SER */
+	uint32_t nchg = 0U;
+	trcut_t c = NULL;
+	struct __cutflo_st_s cfst;
+	cutflo_trans_t(*const cf)(struct __cutflo_st_s*, trcut_t, idate_t) =
+		pick_cf_fun(ser_sp);
+	const unsigned int trbit = UNLIKELY(ser_sp.sparsep)
+		? CUTFLO_HAS_TRANS_BIT : CUTFLO_TRANS_NON_NIL;
+
+	if (ser->ndvvs > 0U &&
+	    (trod_tbl_day(tbl, idate_to_daysi(ser->dvvs[0U].d)) == NULL ||
+	     trod_tbl_day(tbl, idate_to_daysi(
+				  ser->dvvs[ser->ndvvs - 1U].d)) == NULL)) {
+		return -1;
+	}
+	/* init out cut flow state structure */
+	init_cutflo_st(&cfst, ser, ser_sp.tick_val, ser_sp.basis);
+	/* traverse the series, it's chronological */
+	for (size_t i = 0; i < ser->ndvvs; i++) {
+		idate_t dt = ser->dvvs[i].d;
+		const struct trod_day_s *day =
+			trod_tbl_day(tbl, idate_to_daysi(dt));
+
+		if (day->nchg != nchg) {
+			/* update the cut */
+			trod_instant_t di = {
+				idate_y(dt), idate_m(dt), idate_d(dt),
+				TROD_ALL_DAY,
+			};
+
+			nchg = day->nchg;
+			c = make_cut_from_act(c, day->act, di);
+		}
+		/* do fuckall if cut is empty */
+		if (c == NULL) {
+			continue;
+		}
+
+		if (cf(&cfst, c, dt) > trbit) {
+			char buf[32];
+			double val = cutflo_val(&cfst, ser_sp);
+
 			snprint_idate(buf, sizeof(buf), dt);
 			fprintf(whither, "%s\t%.8g\n", buf, val);
 		}
@@ -720,10 +887,60 @@ trod_roll_over_series(
 		free_cut(c);
 	}
 	free_cutflo_st(&cfst);
-	fini_gbs(active);
+	return 0;
+}
+
+static void
+trod_roll_over_intraday(
+	trod_t td, trtsc_t ser, struct __series_spec_s ser_sp, FILE *whither)
+{
+/* like trod_roll_over_series() but at the resolution of SER's stamps,
+ * stamps and trod events are interleaved by their packed keys so
+ * every transition takes effect at the first stamp at or after it */
+	trod_cursor_t tc = make_trod_cursor(td);
+	trcut_t c = NULL;
+	struct __cutflo_st_s cfst;
+	cutflo_trans_t(*const cf)(struct __cutflo_st_s*, trcut_t, idate_t) =
+		pick_cf_fun(ser_sp);
+	const unsigned int trbit = UNLIKELY(ser_sp.sparsep)
+		? CUTFLO_HAS_TRANS_BIT : CUTFLO_TRANS_NON_NIL;
+
+	/* init out cut flow state structure */
+	init_cutflo_st(&cfst, ser, ser_sp.tick_val, ser_sp.basis);
+	/* traverse the series, it's chronological */
+	for (size_t i = 0; i < ser->ndvvs; i++) {
+		const uint64_t k = ser->dvvs[i].k;
+
+		if (trod_cursor_advance_key(tc, k)) {
+			/* update the cut */
+			c = make_cut_from_gbs(
+				c, trod_cursor_active(tc), trod_key_inst(k));
+		}
+		/* do fuckall if cut is empty */
+		if (c == NULL) {
+			continue;
+		}
+
+		/* stamps can share a date, point the cut flow at this one */
+		cfst.dvv_idx = i;
+		if (cf(&cfst, c, ser->dvvs[i].d) > trbit) {
+			char buf[32];
+			double val = cutflo_val(&cfst, ser_sp);
+
+			dt_strf(buf, sizeof(buf), trod_key_inst(k));
+			fprintf(whither, "%s\t%.8g\n", buf, val);
+		}
+	}
+	/* free up resources */
+	if (c) {
+		free_cut(c);
+	}
+	free_cutflo_st(&cfst);
+	free_trod_cursor(tc);
 	return;
 }
 
+
 
 #if defined STANDALONE
 #if defined __INTEL_COMPILER
@@ -741,27 +958,93 @@ main(int argc, char *argv[])
 	struct gengetopt_args_info argi[1];
 	trsch_t sch = NULL;
 	trod_t td = NULL;
+	trod_tbl_t tbl = NULL;
 	trtsc_t ser = NULL;
 	int res = 0;
 
 	if (cmdline_parser(argc, argv, argi)) {
 		exit(1);
 	}
+	if (argi->sweep_given &&
+	    (argi->sweep_arg < -SWEEP_MAX || argi->sweep_arg > SWEEP_MAX)) {
+		fprintf(stderr, "--sweep must be between -%d and %d\n",
+			SWEEP_MAX, SWEEP_MAX);
+		res = 1;
+		goto sch_out;
+	}
+
+	if (argi->calendar_given) {
+		struct trcut_pr_s opt = {
+			.abs = argi->abs_given,
+			.oco = argi->oco_given,
+			.rnd = argi->round_given,
+			.lever = argi->lever_given ? argi->lever_arg : 1.0,
+			.out = stdout,
+		};
+		trcal_t cal;
+		trcut_t c = NULL;
+
+		if ((cal = read_roll_calendar(argi->calendar_arg)) == NULL) {
+			fprintf(stderr, "cannot read roll calendar %s\n",
+				argi->calendar_arg);
+			res = 1;
+			goto sch_out;
+		}
+		for (size_t i = 0; i < argi->inputs_num; i++) {
+			idate_t dt = read_date(argi->inputs[i], NULL);
+			trcut_t x;
+
+			if ((x = roll_calendar_cut(c, cal, dt)) != NULL) {
+				print_cut(c = x, dt, opt);
+			}
+		}
+		if (c != NULL) {
+			free_cut(c);
+		}
+		free_roll_calendar(cal);
+		goto sch_out;
+	}
 
-	if (argi->schema_given) {
+	if (argi->schema_lib_given) {
+		trsch_lib_t lib;
+
+		if (!argi->root_given) {
+			fputs("--schema-lib needs --root\n", stderr);
+			res = 1;
+			goto sch_out;
+		} else if ((lib = open_schema_lib(argi->schema_lib_arg)) == NULL) {
+			fputs("schema library unreadable\n", stderr);
+			res = 1;
+			goto sch_out;
+		}
+		sch = read_schema_lib(lib, argi->root_arg);
+		close_schema_lib(lib);
+	} else if (argi->schema_given) {
 		sch = read_schema(argi->schema_arg);
 	} else {
 		sch = read_schema("-");
 	}
-	if (sch == NULL && argi->schema_given) {
+	if (sch == NULL && argi->schema_given &&
+	    (tbl = read_trod_tbl(argi->schema_arg)) == NULL) {
 		/* retry with trod reader */
 		td = read_trod(argi->schema_arg);
 	}
-	if (UNLIKELY(sch == NULL && td == NULL)) {
+	if (UNLIKELY(sch == NULL && td == NULL && tbl == NULL)) {
 		fputs("schema unreadable\n", stderr);
 		res = 1;
 		goto sch_out;
 	}
+	if (argi->compile_given) {
+		if (sch == NULL) {
+			fputs("only schemas can be compiled\n", stderr);
+			res = 1;
+		} else if (compile_schema(sch, argi->compile_arg) < 0) {
+			fprintf(stderr, "cannot write compiled schema %s\n",
+				argi->compile_arg);
+			res = 1;
+		}
+		goto ser_out;
+	}
 	/* check if we're in series mode */
 	if (argi->series_given) {
 		const char *file = argi->series_arg;
@@ -774,7 +1057,73 @@ main(int argc, char *argv[])
 	}
 
 	/* finally call our main routine */
-	if (ser != NULL && sch != NULL) {
+	if (ser != NULL && sch != NULL &&
+	    (argi->sweep_given || argi->variant_given)) {
+		struct __series_spec_s sp = {
+			.tick_val = argi->tick_value_given
+			? argi->tick_value_arg : 1.0,
+			.basis = argi->basis_given
+			? argi->basis_arg : NAN,
+			.cump = !argi->flow_given,
+			.abs_dimen_p = argi->abs_dimen_given,
+			.sparsep = argi->sparse_given,
+		};
+		int nsh = argi->sweep_given ? abs(argi->sweep_arg) : 0;
+		size_t nsch = argi->variant_given + 1U;
+		size_t nvar = nsch * (2U * nsh + 1U);
+		trsch_t *sch_v = calloc(nsch, sizeof(*sch_v));
+		trsch_t *var = calloc(nvar, sizeof(*var));
+		long njobs = argi->jobs_given
+			? argi->jobs_arg : sysconf(_SC_NPROCESSORS_ONLN);
+		size_t k = 0U;
+
+		if (UNLIKELY(sch_v == NULL || var == NULL)) {
+			fputs("cannot allocate schema variants\n", stderr);
+			nsch = 1U;
+			res = 1;
+			goto var_out;
+		}
+		/* the schema itself, then the variant files */
+		sch_v[0U] = sch;
+		for (size_t i = 1U; i < nsch; i++) {
+			const char *fn = argi->variant_arg[i - 1U];
+
+			if ((sch_v[i] = read_schema(fn)) == NULL) {
+				fprintf(stderr, "cannot read schema %s\n", fn);
+				nsch = i;
+				res = 1;
+				goto var_out;
+			}
+		}
+		/* each of which shifted by -NSH to NSH days */
+		for (size_t i = 0; i < nsch; i++) {
+			for (int d = -nsh; d <= nsh; d++) {
+				var[k++] = d ? shift_schema(sch_v[i], d) : sch_v[i];
+			}
+		}
+		if (njobs < 1) {
+			njobs = 1;
+		} else if ((size_t)njobs > nvar) {
+			njobs = nvar;
+		}
+		if (sweep_series(var, nvar, ser, sp, njobs, stdout) < 0) {
+			fputs("cannot allocate sweep results\n", stderr);
+			res = 1;
+		}
+
+		for (size_t i = 0; i < nvar; i++) {
+			if (var[i] != sch_v[i / (2U * nsh + 1U)]) {
+				free_schema(var[i]);
+			}
+		}
+	var_out:
+		for (size_t i = 1U; i < nsch; i++) {
+			free_schema(sch_v[i]);
+		}
+		free(sch_v);
+		free(var);
+
+	} else if (ser != NULL && sch != NULL) {
 		struct __series_spec_s sp = {
 			.tick_val = argi->tick_value_given
 			? argi->tick_value_arg : 1.0,
@@ -796,12 +1145,54 @@ main(int argc, char *argv[])
 			.abs_dimen_p = argi->abs_dimen_given,
 			.sparsep = argi->sparse_given,
 		};
-		trod_roll_over_series(td, ser, sp, stdout);
+		if (ser->intradayp) {
+			trod_roll_over_intraday(td, ser, sp, stdout);
+		} else {
+			trod_roll_over_series(td, ser, sp, stdout);
+		}
+
+	} else if (ser != NULL && tbl != NULL) {
+		struct __series_spec_s sp = {
+			.tick_val = argi->tick_value_given
+			? argi->tick_value_arg : 1.0,
+			.basis = argi->basis_given
+			? argi->basis_arg : NAN,
+			.cump = !argi->flow_given,
+			.abs_dimen_p = argi->abs_dimen_given,
+			.sparsep = argi->sparse_given,
+		};
+		if (ser->intradayp) {
+			fputs("\
+trod tables only resolve days, use the trod for intraday series\n", stderr);
+			res = 1;
+		} else if (tbl_roll_over_series(tbl, ser, sp, stdout) < 0) {
+			fputs("series not covered by the trod table\n", stderr);
+			res = 1;
+		}
+
+	} else if (sch != NULL && argi->export_given) {
+		idate_t from = argi->from_given
+			? read_date(argi->from_arg, NULL) : 20000101U;
+		idate_t till = argi->till_given
+			? read_date(argi->till_arg, NULL) : 20371231U;
+		FILE *f;
+
+		if ((f = fopen(argi->export_arg, "w")) == NULL) {
+			fprintf(stderr, "cannot open file %s\n",
+				argi->export_arg);
+			res = 1;
+		} else {
+			if (write_roll_calendar(sch, from, till, f) < 0) {
+				fputs("cannot write roll calendar\n", stderr);
+				res = 1;
+			}
+			fclose(f);
+		}
 
 	} else if (sch != NULL && argi->inputs_num == 0) {
 		print_schema(sch, stdout);
 
-	} else if (td != NULL && argi->inputs_num == 0) {
+	} else if ((td != NULL || tbl != NULL) && argi->inputs_num == 0) {
 		fputs("\
 Use trod tool to display trod description files\n", stdout);
 
@@ -813,21 +1204,20 @@ Use trod tool to display trod description files\n", stdout);
 			.lever = argi->lever_given ? argi->lever_arg : 1.0,
 			.out = stdout,
 		};
-		trcut_t c = NULL;
+		trcur_t cur = make_cut_cursor(sch);
+		trcut_t c;
 
 		for (size_t i = 0; i < argi->inputs_num; i++) {
 			idate_t dt = read_date(argi->inputs[i], NULL);
 			daysi_t ds = idate_to_daysi(dt);
 
-			if ((c = make_cut(c, sch, ds))) {
+			if ((c = cut_cursor_advance(cur, ds))) {
 				print_cut(c, dt, opt);
 			}
 		}
-		if (c) {
-			free_cut(c);
-		}
+		free_cut_cursor(cur);
 	} else if (td != NULL) {
-		struct gbs_s active[1U] = {{0U}};
+		trod_cursor_t cur = make_trod_cursor(td);
 		struct trcut_pr_s opt = {
 			.abs = argi->abs_given,
 			.oco = argi->oco_given,
@@ -835,13 +1225,39 @@ Use trod tool to display trod description files\n", stdout);
 			.out = stdout,
 		};
 
-		init_gbs(active, 12U * 5U);
 		for (size_t i = 0; i < argi->inputs_num; i++) {
 			trod_instant_t inst = dt_strp(argi->inputs[i]);
 
-			print_contracts(active, td, inst, opt);
+			print_contracts(cur, inst, opt);
+		}
+		free_trod_cursor(cur);
+
+	} else if (tbl != NULL) {
+		struct trcut_pr_s opt = {
+			.abs = argi->abs_given,
+			.oco = argi->oco_given,
+			.rnd = argi->round_given,
+			.out = stdout,
+		};
+
+		for (size_t i = 0; i < argi->inputs_num; i++) {
+			trod_instant_t inst = dt_strp(argi->inputs[i]);
+			idate_t dt = inst.y * 10000U + inst.m * 100U + inst.d;
+			const struct trod_day_s *day;
+
+			if (!trod_instant_all_day_p(inst)) {
+				fprintf(stderr, "\
+trod tables only resolve days: %s\n", argi->inputs[i]);
+				res = 1;
+			} else if ((day = trod_tbl_day(
+					    tbl, idate_to_daysi(dt))) == NULL) {
+				fprintf(stderr, "\
+not covered by the trod table: %s\n", argi->inputs[i]);
+				res = 1;
+			} else {
+				print_contracts_tbl(day, inst, opt);
+			}
 		}
-		fini_gbs(active);
 
 	} else {
 		/* not reached */
@@ -855,6 +1271,9 @@ ser_out:
 	if (sch != NULL) {
 		free_schema(sch);
 	}
+	if (tbl != NULL) {
+		free_trod_tbl(tbl);
+	}
 sch_out:
 	/* just to make sure */
 	fflush(stdout);